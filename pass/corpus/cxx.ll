@@ -0,0 +1,200 @@
+; C++ constructs: classes with virtual functions, inline functions in comdats,
+; exceptions and static initialization.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+$_ZN5ShapeD2Ev = comdat any
+$_ZN6CircleD0Ev = comdat any
+$_ZNK6Circle4areaEv = comdat any
+$_ZNK6Square4areaEv = comdat any
+$_ZTV6Circle = comdat any
+$_ZTV6Square = comdat any
+$_ZTS6Circle = comdat any
+$_ZTI6Circle = comdat any
+$_ZTS6Square = comdat any
+$_ZTI6Square = comdat any
+$_ZTS5Shape = comdat any
+$_ZTI5Shape = comdat any
+
+%class.Shape = type { ptr, i32 }
+%class.Circle = type { %class.Shape, double }
+%class.Square = type <{ %class.Shape, [4 x i8], double }>
+%struct.Registry = type { ptr, i64, i64 }
+
+@_ZTV6Circle = linkonce_odr dso_local unnamed_addr constant { [5 x ptr] } { [5 x ptr] [ptr null, ptr @_ZTI6Circle, ptr @_ZN5ShapeD2Ev, ptr @_ZN6CircleD0Ev, ptr @_ZNK6Circle4areaEv] }, comdat, align 8
+@_ZTV6Square = linkonce_odr dso_local unnamed_addr constant { [5 x ptr] } { [5 x ptr] [ptr null, ptr @_ZTI6Square, ptr @_ZN5ShapeD2Ev, ptr @_ZN6CircleD0Ev, ptr @_ZNK6Square4areaEv] }, comdat, align 8
+@_ZTVN10__cxxabiv120__si_class_type_infoE = external global ptr
+@_ZTVN10__cxxabiv117__class_type_infoE = external global ptr
+@_ZTS6Circle = linkonce_odr dso_local constant [8 x i8] c"6Circle\00", comdat, align 1
+@_ZTS6Square = linkonce_odr dso_local constant [8 x i8] c"6Square\00", comdat, align 1
+@_ZTS5Shape = linkonce_odr dso_local constant [7 x i8] c"5Shape\00", comdat, align 1
+@_ZTI5Shape = linkonce_odr dso_local constant { ptr, ptr } { ptr getelementptr inbounds (ptr, ptr @_ZTVN10__cxxabiv117__class_type_infoE, i64 2), ptr @_ZTS5Shape }, comdat, align 8
+@_ZTI6Circle = linkonce_odr dso_local constant { ptr, ptr, ptr } { ptr getelementptr inbounds (ptr, ptr @_ZTVN10__cxxabiv120__si_class_type_infoE, i64 2), ptr @_ZTS6Circle, ptr @_ZTI5Shape }, comdat, align 8
+@_ZTI6Square = linkonce_odr dso_local constant { ptr, ptr, ptr } { ptr getelementptr inbounds (ptr, ptr @_ZTVN10__cxxabiv120__si_class_type_infoE, i64 2), ptr @_ZTS6Square, ptr @_ZTI5Shape }, comdat, align 8
+@_ZTISt9exception = external constant ptr
+@registry = dso_local global %struct.Registry zeroinitializer, align 8
+@_ZL10unit_scale = internal global double 0.000000e+00, align 8
+@llvm.global_ctors = appending global [1 x { i32, ptr, ptr }] [{ i32, ptr, ptr } { i32 65535, ptr @_GLOBAL__sub_I_shapes.cpp, ptr null }]
+
+declare ptr @_Znwm(i64)
+declare void @_ZdlPv(ptr)
+declare ptr @__cxa_allocate_exception(i64)
+declare void @__cxa_throw(ptr, ptr, ptr)
+declare ptr @__cxa_begin_catch(ptr)
+declare void @__cxa_end_catch()
+declare i32 @__gxx_personality_v0(...)
+declare i32 @llvm.eh.typeid.for(ptr)
+declare double @llvm.sqrt.f64(double)
+declare ptr @realloc(ptr, i64)
+
+define linkonce_odr dso_local void @_ZN5ShapeD2Ev(ptr %this) unnamed_addr #0 comdat align 2 {
+entry:
+  ret void
+}
+
+define linkonce_odr dso_local void @_ZN6CircleD0Ev(ptr %this) unnamed_addr #0 comdat align 2 {
+entry:
+  call void @_ZdlPv(ptr %this)
+  ret void
+}
+
+define linkonce_odr dso_local double @_ZNK6Circle4areaEv(ptr %this) unnamed_addr #0 comdat align 2 {
+entry:
+  %rp = getelementptr inbounds %class.Circle, ptr %this, i64 0, i32 1
+  %r = load double, ptr %rp, align 8
+  %r2 = fmul double %r, %r
+  %a = fmul double %r2, 0x400921FB54442D18
+  %scale = load double, ptr @_ZL10unit_scale, align 8
+  %res = fmul double %a, %scale
+  ret double %res
+}
+
+define linkonce_odr dso_local double @_ZNK6Square4areaEv(ptr %this) unnamed_addr #0 comdat align 2 {
+entry:
+  %sp = getelementptr inbounds %class.Square, ptr %this, i64 0, i32 2
+  %s = load double, ptr %sp, align 4
+  %a = fmul double %s, %s
+  %scale = load double, ptr @_ZL10unit_scale, align 8
+  %res = fmul double %a, %scale
+  ret double %res
+}
+
+define dso_local noundef nonnull ptr @_Z10makeCircled(double noundef %r) #1 personality ptr @__gxx_personality_v0 {
+entry:
+  %neg = fcmp olt double %r, 0.000000e+00
+  br i1 %neg, label %throw, label %alloc
+
+throw:
+  %exn = call ptr @__cxa_allocate_exception(i64 8)
+  store ptr getelementptr inbounds ({ [5 x ptr] }, ptr @_ZTV6Circle, i32 0, inrange i32 0, i32 2), ptr %exn, align 8
+  call void @__cxa_throw(ptr %exn, ptr @_ZTISt9exception, ptr null)
+  unreachable
+
+alloc:
+  %obj = call noalias nonnull ptr @_Znwm(i64 24)
+  store ptr getelementptr inbounds ({ [5 x ptr] }, ptr @_ZTV6Circle, i32 0, inrange i32 0, i32 2), ptr %obj, align 8
+  %idp = getelementptr inbounds %class.Shape, ptr %obj, i64 0, i32 1
+  %id = invoke i32 @_Z8registerP5Shape(ptr %obj)
+          to label %registered unwind label %lpad
+
+registered:
+  store i32 %id, ptr %idp, align 8
+  %rp = getelementptr inbounds %class.Circle, ptr %obj, i64 0, i32 1
+  store double %r, ptr %rp, align 8
+  ret ptr %obj
+
+lpad:
+  %lp = landingpad { ptr, i32 }
+          cleanup
+  call void @_ZdlPv(ptr %obj)
+  resume { ptr, i32 } %lp
+}
+
+define dso_local i32 @_Z8registerP5Shape(ptr noundef %shape) #1 {
+entry:
+  %sizep = getelementptr inbounds %struct.Registry, ptr @registry, i64 0, i32 1
+  %size = load i64, ptr %sizep, align 8
+  %capp = getelementptr inbounds %struct.Registry, ptr @registry, i64 0, i32 2
+  %cap = load i64, ptr %capp, align 8
+  %full = icmp eq i64 %size, %cap
+  %items = load ptr, ptr @registry, align 8
+  br i1 %full, label %grow, label %append
+
+grow:
+  %twice = shl i64 %cap, 1
+  %newcap = call i64 @llvm.umax.i64(i64 %twice, i64 8)
+  %bytes = shl i64 %newcap, 3
+  %newitems = call ptr @realloc(ptr %items, i64 %bytes)
+  store ptr %newitems, ptr @registry, align 8
+  store i64 %newcap, ptr %capp, align 8
+  br label %append
+
+append:
+  %base = phi ptr [ %items, %entry ], [ %newitems, %grow ]
+  %slot = getelementptr inbounds ptr, ptr %base, i64 %size
+  store ptr %shape, ptr %slot, align 8
+  %size.next = add nuw i64 %size, 1
+  store i64 %size.next, ptr %sizep, align 8
+  %id = trunc i64 %size to i32
+  ret i32 %id
+}
+
+declare i64 @llvm.umax.i64(i64, i64)
+
+define dso_local double @_Z9totalAreav() #1 personality ptr @__gxx_personality_v0 {
+entry:
+  %size = load i64, ptr getelementptr inbounds (%struct.Registry, ptr @registry, i64 0, i32 1), align 8
+  %empty = icmp eq i64 %size, 0
+  br i1 %empty, label %done, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %cont ]
+  %sum = phi double [ 0.000000e+00, %entry ], [ %sum.next, %cont ]
+  %items = load ptr, ptr @registry, align 8
+  %slot = getelementptr inbounds ptr, ptr %items, i64 %i
+  %shape = load ptr, ptr %slot, align 8
+  %vtable = load ptr, ptr %shape, align 8
+  %fnp = getelementptr inbounds ptr, ptr %vtable, i64 2
+  %fn = load ptr, ptr %fnp, align 8
+  %area = invoke double %fn(ptr %shape)
+          to label %cont unwind label %lpad
+
+cont:
+  %sum.next = fadd double %sum, %area
+  %i.next = add nuw i64 %i, 1
+  %more = icmp ult i64 %i.next, %size
+  br i1 %more, label %loop, label %done
+
+lpad:
+  %lp = landingpad { ptr, i32 }
+          catch ptr @_ZTISt9exception
+  %sel = extractvalue { ptr, i32 } %lp, 1
+  %tid = call i32 @llvm.eh.typeid.for(ptr @_ZTISt9exception)
+  %match = icmp eq i32 %sel, %tid
+  br i1 %match, label %catch, label %rethrow
+
+catch:
+  %obj = extractvalue { ptr, i32 } %lp, 0
+  %e = call ptr @__cxa_begin_catch(ptr %obj)
+  call void @__cxa_end_catch()
+  br label %done
+
+rethrow:
+  resume { ptr, i32 } %lp
+
+done:
+  %res = phi double [ 0.000000e+00, %entry ], [ %sum.next, %cont ], [ -1.000000e+00, %catch ]
+  ret double %res
+}
+
+define internal void @_GLOBAL__sub_I_shapes.cpp() #2 section ".text.startup" {
+entry:
+  %s = call double @llvm.sqrt.f64(double 2.000000e+00)
+  store double %s, ptr @_ZL10unit_scale, align 8
+  ret void
+}
+
+attributes #0 = { mustprogress noinline nounwind uwtable "frame-pointer"="all" "min-legal-vector-width"="0" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+cmov,+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
+attributes #1 = { mustprogress uwtable "frame-pointer"="all" "min-legal-vector-width"="0" "no-trapping-math"="true" "stack-protector-buffer-size"="8" "target-cpu"="x86-64" "target-features"="+cmov,+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
+attributes #2 = { uwtable "frame-pointer"="all" "target-cpu"="x86-64" "target-features"="+cmov,+cx8,+fxsr,+mmx,+sse,+sse2,+x87" "tune-cpu"="generic" }
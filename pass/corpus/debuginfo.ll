@@ -0,0 +1,214 @@
+; C compiled with -g: debug locations on every instruction, dbg.declare and
+; dbg.value intrinsics, lexical blocks, a struct type, a global variable and
+; an inlined call, as clang emits them before optimization.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.point = type { i32, i32 }
+
+@origin = dso_local global %struct.point zeroinitializer, align 4, !dbg !0
+
+define dso_local i32 @dist2(ptr %a, ptr %b) !dbg !20 {
+entry:
+  %a.addr = alloca ptr, align 8
+  %b.addr = alloca ptr, align 8
+  %dx = alloca i32, align 4
+  %dy = alloca i32, align 4
+  store ptr %a, ptr %a.addr, align 8
+  call void @llvm.dbg.declare(metadata ptr %a.addr, metadata !25, metadata !DIExpression()), !dbg !30
+  store ptr %b, ptr %b.addr, align 8
+  call void @llvm.dbg.declare(metadata ptr %b.addr, metadata !26, metadata !DIExpression()), !dbg !31
+  call void @llvm.dbg.declare(metadata ptr %dx, metadata !27, metadata !DIExpression()), !dbg !32
+  %0 = load ptr, ptr %a.addr, align 8, !dbg !33
+  %1 = load i32, ptr %0, align 4, !dbg !33
+  %2 = load ptr, ptr %b.addr, align 8, !dbg !34
+  %3 = load i32, ptr %2, align 4, !dbg !34
+  %sub = sub nsw i32 %1, %3, !dbg !35
+  store i32 %sub, ptr %dx, align 4, !dbg !32
+  call void @llvm.dbg.declare(metadata ptr %dy, metadata !28, metadata !DIExpression()), !dbg !36
+  %4 = load ptr, ptr %a.addr, align 8, !dbg !37
+  %y = getelementptr inbounds %struct.point, ptr %4, i32 0, i32 1, !dbg !37
+  %5 = load i32, ptr %y, align 4, !dbg !37
+  %6 = load ptr, ptr %b.addr, align 8, !dbg !38
+  %y1 = getelementptr inbounds %struct.point, ptr %6, i32 0, i32 1, !dbg !38
+  %7 = load i32, ptr %y1, align 4, !dbg !38
+  %sub2 = sub nsw i32 %5, %7, !dbg !39
+  store i32 %sub2, ptr %dy, align 4, !dbg !36
+  %8 = load i32, ptr %dx, align 4, !dbg !40
+  %mul = mul nsw i32 %8, %8, !dbg !40
+  %9 = load i32, ptr %dy, align 4, !dbg !41
+  %mul3 = mul nsw i32 %9, %9, !dbg !41
+  %add = add nsw i32 %mul, %mul3, !dbg !42
+  ret i32 %add, !dbg !43
+}
+
+define dso_local i32 @nearest(ptr %points, i32 %n) !dbg !50 {
+entry:
+  %points.addr = alloca ptr, align 8
+  %n.addr = alloca i32, align 4
+  %best = alloca i32, align 4
+  %best_d = alloca i32, align 4
+  %i = alloca i32, align 4
+  %d = alloca i32, align 4
+  store ptr %points, ptr %points.addr, align 8
+  call void @llvm.dbg.declare(metadata ptr %points.addr, metadata !53, metadata !DIExpression()), !dbg !60
+  store i32 %n, ptr %n.addr, align 4
+  call void @llvm.dbg.declare(metadata ptr %n.addr, metadata !54, metadata !DIExpression()), !dbg !61
+  call void @llvm.dbg.declare(metadata ptr %best, metadata !55, metadata !DIExpression()), !dbg !62
+  store i32 -1, ptr %best, align 4, !dbg !62
+  call void @llvm.dbg.declare(metadata ptr %best_d, metadata !56, metadata !DIExpression()), !dbg !63
+  store i32 2147483647, ptr %best_d, align 4, !dbg !63
+  call void @llvm.dbg.declare(metadata ptr %i, metadata !57, metadata !DIExpression()), !dbg !64
+  store i32 0, ptr %i, align 4, !dbg !64
+  br label %for.cond, !dbg !65
+
+for.cond:
+  %0 = load i32, ptr %i, align 4, !dbg !66
+  %1 = load i32, ptr %n.addr, align 4, !dbg !66
+  %cmp = icmp slt i32 %0, %1, !dbg !66
+  br i1 %cmp, label %for.body, label %for.end, !dbg !65
+
+for.body:
+  call void @llvm.dbg.declare(metadata ptr %d, metadata !59, metadata !DIExpression()), !dbg !67
+  %2 = load ptr, ptr %points.addr, align 8, !dbg !68
+  %3 = load i32, ptr %i, align 4, !dbg !68
+  %idxprom = sext i32 %3 to i64, !dbg !68
+  %arrayidx = getelementptr inbounds %struct.point, ptr %2, i64 %idxprom, !dbg !68
+  %call = call i32 @dist2(ptr %arrayidx, ptr @origin), !dbg !69
+  store i32 %call, ptr %d, align 4, !dbg !67
+  %4 = load i32, ptr %d, align 4, !dbg !70
+  %5 = load i32, ptr %best_d, align 4, !dbg !70
+  %cmp1 = icmp slt i32 %4, %5, !dbg !70
+  br i1 %cmp1, label %if.then, label %for.inc, !dbg !71
+
+if.then:
+  %6 = load i32, ptr %d, align 4, !dbg !72
+  store i32 %6, ptr %best_d, align 4, !dbg !72
+  %7 = load i32, ptr %i, align 4, !dbg !73
+  store i32 %7, ptr %best, align 4, !dbg !73
+  br label %for.inc, !dbg !74
+
+for.inc:
+  %8 = load i32, ptr %i, align 4, !dbg !75
+  %inc = add nsw i32 %8, 1, !dbg !75
+  store i32 %inc, ptr %i, align 4, !dbg !75
+  br label %for.cond, !dbg !76, !llvm.loop !77
+
+for.end:
+  %9 = load i32, ptr %best, align 4, !dbg !79
+  ret i32 %9, !dbg !80
+}
+
+; dist2 inlined into an optimized caller, with dbg.value
+define dso_local i32 @dist2_origin(i32 %x, i32 %y) !dbg !90 {
+entry:
+  call void @llvm.dbg.value(metadata i32 %x, metadata !93, metadata !DIExpression()), !dbg !95
+  call void @llvm.dbg.value(metadata i32 %y, metadata !94, metadata !DIExpression()), !dbg !95
+  %0 = load i32, ptr @origin, align 4, !dbg !96
+  %sub.i = sub nsw i32 %x, %0, !dbg !98
+  call void @llvm.dbg.value(metadata i32 %sub.i, metadata !27, metadata !DIExpression()), !dbg !99
+  %1 = load i32, ptr getelementptr inbounds (%struct.point, ptr @origin, i32 0, i32 1), align 4, !dbg !100
+  %sub2.i = sub nsw i32 %y, %1, !dbg !101
+  call void @llvm.dbg.value(metadata i32 %sub2.i, metadata !28, metadata !DIExpression()), !dbg !99
+  %mul.i = mul nsw i32 %sub.i, %sub.i, !dbg !102
+  %mul3.i = mul nsw i32 %sub2.i, %sub2.i, !dbg !103
+  %add.i = add nsw i32 %mul.i, %mul3.i, !dbg !104
+  ret i32 %add.i, !dbg !105
+}
+
+declare void @llvm.dbg.declare(metadata, metadata, metadata)
+declare void @llvm.dbg.value(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!2}
+!llvm.module.flags = !{!10, !11, !12}
+!llvm.ident = !{!13}
+
+!0 = !DIGlobalVariableExpression(var: !1, expr: !DIExpression())
+!1 = distinct !DIGlobalVariable(name: "origin", scope: !2, file: !3, line: 3, type: !5, isLocal: false, isDefinition: true)
+!2 = distinct !DICompileUnit(language: DW_LANG_C11, file: !3, producer: "clang version 18.1.3", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, globals: !4, splitDebugInlining: false, nameTableKind: None)
+!3 = !DIFile(filename: "points.c", directory: "/src")
+!4 = !{!0}
+!5 = distinct !DICompositeType(tag: DW_TAG_structure_type, name: "point", file: !3, line: 1, size: 64, elements: !6)
+!6 = !{!7, !8}
+!7 = !DIDerivedType(tag: DW_TAG_member, name: "x", scope: !5, file: !3, line: 1, baseType: !9, size: 32)
+!8 = !DIDerivedType(tag: DW_TAG_member, name: "y", scope: !5, file: !3, line: 1, baseType: !9, size: 32, offset: 32)
+!9 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!10 = !{i32 7, !"Dwarf Version", i32 5}
+!11 = !{i32 2, !"Debug Info Version", i32 3}
+!12 = !{i32 1, !"wchar_size", i32 4}
+!13 = !{!"clang version 18.1.3"}
+!20 = distinct !DISubprogram(name: "dist2", scope: !3, file: !3, line: 5, type: !21, scopeLine: 5, flags: DIFlagPrototyped, spFlags: DISPFlagDefinition, unit: !2, retainedNodes: !24)
+!21 = !DISubroutineType(types: !22)
+!22 = !{!9, !23, !23}
+!23 = !DIDerivedType(tag: DW_TAG_pointer_type, baseType: !5, size: 64)
+!24 = !{}
+!25 = !DILocalVariable(name: "a", arg: 1, scope: !20, file: !3, line: 5, type: !23)
+!26 = !DILocalVariable(name: "b", arg: 2, scope: !20, file: !3, line: 5, type: !23)
+!27 = !DILocalVariable(name: "dx", scope: !20, file: !3, line: 6, type: !9)
+!28 = !DILocalVariable(name: "dy", scope: !20, file: !3, line: 7, type: !9)
+!30 = !DILocation(line: 5, column: 31, scope: !20)
+!31 = !DILocation(line: 5, column: 48, scope: !20)
+!32 = !DILocation(line: 6, column: 7, scope: !20)
+!33 = !DILocation(line: 6, column: 15, scope: !20)
+!34 = !DILocation(line: 6, column: 22, scope: !20)
+!35 = !DILocation(line: 6, column: 20, scope: !20)
+!36 = !DILocation(line: 7, column: 7, scope: !20)
+!37 = !DILocation(line: 7, column: 15, scope: !20)
+!38 = !DILocation(line: 7, column: 22, scope: !20)
+!39 = !DILocation(line: 7, column: 20, scope: !20)
+!40 = !DILocation(line: 8, column: 13, scope: !20)
+!41 = !DILocation(line: 8, column: 23, scope: !20)
+!42 = !DILocation(line: 8, column: 18, scope: !20)
+!43 = !DILocation(line: 8, column: 3, scope: !20)
+!50 = distinct !DISubprogram(name: "nearest", scope: !3, file: !3, line: 11, type: !51, scopeLine: 11, flags: DIFlagPrototyped, spFlags: DISPFlagDefinition, unit: !2, retainedNodes: !24)
+!51 = !DISubroutineType(types: !52)
+!52 = !{!9, !23, !9}
+!53 = !DILocalVariable(name: "points", arg: 1, scope: !50, file: !3, line: 11, type: !23)
+!54 = !DILocalVariable(name: "n", arg: 2, scope: !50, file: !3, line: 11, type: !9)
+!55 = !DILocalVariable(name: "best", scope: !50, file: !3, line: 12, type: !9)
+!56 = !DILocalVariable(name: "best_d", scope: !50, file: !3, line: 13, type: !9)
+!57 = !DILocalVariable(name: "i", scope: !58, file: !3, line: 14, type: !9)
+!58 = distinct !DILexicalBlock(scope: !50, file: !3, line: 14, column: 3)
+!59 = !DILocalVariable(name: "d", scope: !81, file: !3, line: 15, type: !9)
+!60 = !DILocation(line: 11, column: 27, scope: !50)
+!61 = !DILocation(line: 11, column: 39, scope: !50)
+!62 = !DILocation(line: 12, column: 7, scope: !50)
+!63 = !DILocation(line: 13, column: 7, scope: !50)
+!64 = !DILocation(line: 14, column: 12, scope: !58)
+!65 = !DILocation(line: 14, column: 8, scope: !58)
+!66 = !DILocation(line: 14, column: 21, scope: !58)
+!67 = !DILocation(line: 15, column: 9, scope: !81)
+!68 = !DILocation(line: 15, column: 20, scope: !81)
+!69 = !DILocation(line: 15, column: 13, scope: !81)
+!70 = !DILocation(line: 16, column: 9, scope: !81)
+!71 = !DILocation(line: 16, column: 9, scope: !82)
+!72 = !DILocation(line: 17, column: 14, scope: !83)
+!73 = !DILocation(line: 18, column: 12, scope: !83)
+!74 = !DILocation(line: 19, column: 5, scope: !83)
+!75 = !DILocation(line: 14, column: 28, scope: !58)
+!76 = !DILocation(line: 14, column: 3, scope: !58)
+!77 = distinct !{!77, !76, !78}
+!78 = !DILocation(line: 20, column: 3, scope: !58)
+!79 = !DILocation(line: 21, column: 10, scope: !50)
+!80 = !DILocation(line: 21, column: 3, scope: !50)
+!81 = distinct !DILexicalBlock(scope: !58, file: !3, line: 14, column: 33)
+!82 = distinct !DILexicalBlock(scope: !81, file: !3, line: 16, column: 9)
+!83 = distinct !DILexicalBlock(scope: !82, file: !3, line: 16, column: 26)
+!90 = distinct !DISubprogram(name: "dist2_origin", scope: !3, file: !3, line: 24, type: !91, scopeLine: 24, flags: DIFlagPrototyped, spFlags: DISPFlagDefinition | DISPFlagOptimized, unit: !2, retainedNodes: !92)
+!91 = !DISubroutineType(types: !106)
+!92 = !{!93, !94}
+!93 = !DILocalVariable(name: "x", arg: 1, scope: !90, file: !3, line: 24, type: !9)
+!94 = !DILocalVariable(name: "y", arg: 2, scope: !90, file: !3, line: 24, type: !9)
+!95 = !DILocation(line: 0, scope: !90)
+!96 = !DILocation(line: 6, column: 22, scope: !20, inlinedAt: !97)
+!97 = distinct !DILocation(line: 26, column: 10, scope: !90)
+!98 = !DILocation(line: 6, column: 20, scope: !20, inlinedAt: !97)
+!99 = !DILocation(line: 0, scope: !20, inlinedAt: !97)
+!100 = !DILocation(line: 7, column: 22, scope: !20, inlinedAt: !97)
+!101 = !DILocation(line: 7, column: 20, scope: !20, inlinedAt: !97)
+!102 = !DILocation(line: 8, column: 13, scope: !20, inlinedAt: !97)
+!103 = !DILocation(line: 8, column: 23, scope: !20, inlinedAt: !97)
+!104 = !DILocation(line: 8, column: 18, scope: !20, inlinedAt: !97)
+!105 = !DILocation(line: 26, column: 3, scope: !90)
+!106 = !{!9, !9, !9}
@@ -0,0 +1,388 @@
+; C-style kernels: loops, pointer arithmetic, switches and calls into libc,
+; roughly what clang -O1 produces for plain C code.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.vec = type { ptr, i64, i64 }
+%struct.node = type { i32, ptr, ptr }
+%struct.stats = type { double, double, double, i64 }
+
+@.str.overflow = private unnamed_addr constant [25 x i8] c"vector capacity overflow\00", align 1
+@.str.fmt = private unnamed_addr constant [22 x i8] c"min %f max %f avg %f\0A\00", align 1
+@.str.state = private unnamed_addr constant [15 x i8] c"bad state: %d\0A\00", align 1
+@counter = dso_local global i64 0, align 8
+@last_error = internal global i32 0, align 4
+
+declare ptr @malloc(i64)
+declare ptr @realloc(ptr, i64)
+declare void @free(ptr)
+declare i32 @printf(ptr, ...)
+declare i32 @puts(ptr)
+declare void @abort()
+declare void @llvm.memcpy.p0.p0.i64(ptr, ptr, i64, i1)
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1)
+
+define dso_local i64 @sum_i32(ptr %a, i64 %n) {
+entry:
+  %empty = icmp eq i64 %n, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %acc.next, %loop ]
+  %p = getelementptr inbounds i32, ptr %a, i64 %i
+  %v = load i32, ptr %p, align 4
+  %v64 = sext i32 %v to i64
+  %acc.next = add nsw i64 %acc, %v64
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i64 [ 0, %entry ], [ %acc.next, %loop ]
+  ret i64 %res
+}
+
+define dso_local void @matmul(ptr noalias %c, ptr noalias %a, ptr noalias %b, i32 %n) {
+entry:
+  %n64 = sext i32 %n to i64
+  %pos = icmp sgt i32 %n, 0
+  br i1 %pos, label %outer, label %exit
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %row = mul nsw i64 %i, %n64
+  br label %middle
+
+middle:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %middle.latch ]
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %middle ], [ %k.next, %inner ]
+  %sum = phi double [ 0.000000e+00, %middle ], [ %sum.next, %inner ]
+  %aidx = add nsw i64 %row, %k
+  %ap = getelementptr inbounds double, ptr %a, i64 %aidx
+  %av = load double, ptr %ap, align 8
+  %krow = mul nsw i64 %k, %n64
+  %bidx = add nsw i64 %krow, %j
+  %bp = getelementptr inbounds double, ptr %b, i64 %bidx
+  %bv = load double, ptr %bp, align 8
+  %prod = fmul double %av, %bv
+  %sum.next = fadd double %sum, %prod
+  %k.next = add nuw nsw i64 %k, 1
+  %k.done = icmp eq i64 %k.next, %n64
+  br i1 %k.done, label %middle.latch, label %inner
+
+middle.latch:
+  %cidx = add nsw i64 %row, %j
+  %cp = getelementptr inbounds double, ptr %c, i64 %cidx
+  store double %sum.next, ptr %cp, align 8
+  %j.next = add nuw nsw i64 %j, 1
+  %j.done = icmp eq i64 %j.next, %n64
+  br i1 %j.done, label %outer.latch, label %middle
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.done = icmp eq i64 %i.next, %n64
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+define dso_local i64 @my_strlen(ptr %s) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %p = getelementptr inbounds i8, ptr %s, i64 %i
+  %c = load i8, ptr %p, align 1
+  %i.next = add nuw i64 %i, 1
+  %end = icmp eq i8 %c, 0
+  br i1 %end, label %exit, label %loop
+
+exit:
+  ret i64 %i
+}
+
+define dso_local i32 @my_strcmp(ptr %a, ptr %b) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %next ]
+  %pa = getelementptr inbounds i8, ptr %a, i64 %i
+  %pb = getelementptr inbounds i8, ptr %b, i64 %i
+  %ca = load i8, ptr %pa, align 1
+  %cb = load i8, ptr %pb, align 1
+  %ne = icmp ne i8 %ca, %cb
+  br i1 %ne, label %diff, label %next
+
+next:
+  %end = icmp eq i8 %ca, 0
+  %i.next = add nuw i64 %i, 1
+  br i1 %end, label %equal, label %loop
+
+diff:
+  %za = zext i8 %ca to i32
+  %zb = zext i8 %cb to i32
+  %d = sub nsw i32 %za, %zb
+  ret i32 %d
+
+equal:
+  ret i32 0
+}
+
+define dso_local i32 @vec_push(ptr %v, i32 %x) {
+entry:
+  %lenp = getelementptr inbounds %struct.vec, ptr %v, i64 0, i32 1
+  %len = load i64, ptr %lenp, align 8
+  %capp = getelementptr inbounds %struct.vec, ptr %v, i64 0, i32 2
+  %cap = load i64, ptr %capp, align 8
+  %full = icmp eq i64 %len, %cap
+  br i1 %full, label %grow, label %store
+
+grow:
+  %iszero = icmp eq i64 %cap, 0
+  %dbl = shl i64 %cap, 1
+  %newcap = select i1 %iszero, i64 8, i64 %dbl
+  %over = icmp ugt i64 %newcap, 1152921504606846975
+  br i1 %over, label %overflow, label %realloc
+
+overflow:
+  %r = call i32 @puts(ptr @.str.overflow)
+  store i32 1, ptr @last_error, align 4
+  ret i32 -1
+
+realloc:
+  %data.old = load ptr, ptr %v, align 8
+  %bytes = shl i64 %newcap, 2
+  %data.new = call ptr @realloc(ptr %data.old, i64 %bytes)
+  %failed = icmp eq ptr %data.new, null
+  br i1 %failed, label %oom, label %grown
+
+oom:
+  store i32 2, ptr @last_error, align 4
+  ret i32 -1
+
+grown:
+  store ptr %data.new, ptr %v, align 8
+  store i64 %newcap, ptr %capp, align 8
+  br label %store
+
+store:
+  %data = load ptr, ptr %v, align 8
+  %slot = getelementptr inbounds i32, ptr %data, i64 %len
+  store i32 %x, ptr %slot, align 4
+  %len.next = add nuw i64 %len, 1
+  store i64 %len.next, ptr %lenp, align 8
+  %cnt = load i64, ptr @counter, align 8
+  %cnt.next = add i64 %cnt, 1
+  store i64 %cnt.next, ptr @counter, align 8
+  ret i32 0
+}
+
+define dso_local void @vec_copy(ptr %dst, ptr %src) {
+entry:
+  %lenp = getelementptr inbounds %struct.vec, ptr %src, i64 0, i32 1
+  %len = load i64, ptr %lenp, align 8
+  %bytes = shl i64 %len, 2
+  %mem = call ptr @malloc(i64 %bytes)
+  %data = load ptr, ptr %src, align 8
+  call void @llvm.memcpy.p0.p0.i64(ptr align 4 %mem, ptr align 4 %data, i64 %bytes, i1 false)
+  store ptr %mem, ptr %dst, align 8
+  %dlenp = getelementptr inbounds %struct.vec, ptr %dst, i64 0, i32 1
+  store i64 %len, ptr %dlenp, align 8
+  %dcapp = getelementptr inbounds %struct.vec, ptr %dst, i64 0, i32 2
+  store i64 %len, ptr %dcapp, align 8
+  ret void
+}
+
+define dso_local ptr @tree_insert(ptr %root, i32 %key) {
+entry:
+  %isnull = icmp eq ptr %root, null
+  br i1 %isnull, label %new, label %walk
+
+new:
+  %n = call ptr @malloc(i64 24)
+  store i32 %key, ptr %n, align 8
+  %l = getelementptr inbounds %struct.node, ptr %n, i64 0, i32 1
+  call void @llvm.memset.p0.i64(ptr align 8 %l, i8 0, i64 16, i1 false)
+  ret ptr %n
+
+walk:
+  %k = load i32, ptr %root, align 8
+  %less = icmp slt i32 %key, %k
+  %leftp = getelementptr inbounds %struct.node, ptr %root, i64 0, i32 1
+  %rightp = getelementptr inbounds %struct.node, ptr %root, i64 0, i32 2
+  %childp = select i1 %less, ptr %leftp, ptr %rightp
+  %child = load ptr, ptr %childp, align 8
+  %sub = call ptr @tree_insert(ptr %child, i32 %key)
+  store ptr %sub, ptr %childp, align 8
+  ret ptr %root
+}
+
+define dso_local void @tree_free(ptr %root) {
+entry:
+  %isnull = icmp eq ptr %root, null
+  br i1 %isnull, label %exit, label %free
+
+free:
+  %leftp = getelementptr inbounds %struct.node, ptr %root, i64 0, i32 1
+  %left = load ptr, ptr %leftp, align 8
+  tail call void @tree_free(ptr %left)
+  %rightp = getelementptr inbounds %struct.node, ptr %root, i64 0, i32 2
+  %right = load ptr, ptr %rightp, align 8
+  tail call void @tree_free(ptr %right)
+  tail call void @free(ptr %root)
+  br label %exit
+
+exit:
+  ret void
+}
+
+define internal void @stats_update(ptr %s, double %x) {
+entry:
+  %minp = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 0
+  %maxp = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 1
+  %sump = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 2
+  %np = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 3
+  %min = load double, ptr %minp, align 8
+  %max = load double, ptr %maxp, align 8
+  %sum = load double, ptr %sump, align 8
+  %n = load i64, ptr %np, align 8
+  %lt = fcmp olt double %x, %min
+  %min.next = select i1 %lt, double %x, double %min
+  %gt = fcmp ogt double %x, %max
+  %max.next = select i1 %gt, double %x, double %max
+  %sum.next = fadd double %sum, %x
+  %n.next = add i64 %n, 1
+  store double %min.next, ptr %minp, align 8
+  store double %max.next, ptr %maxp, align 8
+  store double %sum.next, ptr %sump, align 8
+  store i64 %n.next, ptr %np, align 8
+  ret void
+}
+
+define dso_local void @print_stats(ptr %values, i64 %n) {
+entry:
+  %s = alloca %struct.stats, align 8
+  store double 0x7FF0000000000000, ptr %s, align 8
+  %maxp = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 1
+  store double 0xFFF0000000000000, ptr %maxp, align 8
+  %sump = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 2
+  store double 0.000000e+00, ptr %sump, align 8
+  %np = getelementptr inbounds %struct.stats, ptr %s, i64 0, i32 3
+  store i64 0, ptr %np, align 8
+  %empty = icmp eq i64 %n, 0
+  br i1 %empty, label %print, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %p = getelementptr inbounds double, ptr %values, i64 %i
+  %x = load double, ptr %p, align 8
+  call void @stats_update(ptr %s, double %x)
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %print, label %loop
+
+print:
+  %min = load double, ptr %s, align 8
+  %max = load double, ptr %maxp, align 8
+  %sum = load double, ptr %sump, align 8
+  %cnt = load i64, ptr %np, align 8
+  %cntf = uitofp i64 %cnt to double
+  %avg = fdiv double %sum, %cntf
+  %r = call i32 (ptr, ...) @printf(ptr @.str.fmt, double %min, double %max, double %avg)
+  ret void
+}
+
+define dso_local i32 @tokenize_state(i32 %state, i8 %c) {
+entry:
+  switch i32 %state, label %bad [
+    i32 0, label %start
+    i32 1, label %ident
+    i32 2, label %number
+    i32 3, label %string
+  ]
+
+start:
+  %isdigit.lo = icmp uge i8 %c, 48
+  %isdigit.hi = icmp ule i8 %c, 57
+  %isdigit = and i1 %isdigit.lo, %isdigit.hi
+  br i1 %isdigit, label %to.number, label %start.2
+
+start.2:
+  %isquote = icmp eq i8 %c, 34
+  br i1 %isquote, label %to.string, label %start.3
+
+start.3:
+  %lower = or i8 %c, 32
+  %alpha.lo = icmp uge i8 %lower, 97
+  %alpha.hi = icmp ule i8 %lower, 122
+  %isalpha = and i1 %alpha.lo, %alpha.hi
+  %next.start = select i1 %isalpha, i32 1, i32 0
+  ret i32 %next.start
+
+ident:
+  %l2 = or i8 %c, 32
+  %a.lo = icmp uge i8 %l2, 97
+  %a.hi = icmp ule i8 %l2, 122
+  %a = and i1 %a.lo, %a.hi
+  %us = icmp eq i8 %c, 95
+  %cont = or i1 %a, %us
+  %next.ident = select i1 %cont, i32 1, i32 0
+  ret i32 %next.ident
+
+number:
+  %d.lo = icmp uge i8 %c, 48
+  %d.hi = icmp ule i8 %c, 57
+  %d = and i1 %d.lo, %d.hi
+  %next.number = select i1 %d, i32 2, i32 0
+  ret i32 %next.number
+
+string:
+  %close = icmp eq i8 %c, 34
+  %next.string = select i1 %close, i32 0, i32 3
+  ret i32 %next.string
+
+to.number:
+  ret i32 2
+
+to.string:
+  ret i32 3
+
+bad:
+  %r = call i32 (ptr, ...) @printf(ptr @.str.state, i32 %state)
+  call void @abort()
+  unreachable
+}
+
+define dso_local i32 @count_tokens(ptr %s) {
+entry:
+  br label %loop
+
+loop:
+  %p = phi ptr [ %s, %entry ], [ %p.next, %body ]
+  %state = phi i32 [ 0, %entry ], [ %state.next, %body ]
+  %tokens = phi i32 [ 0, %entry ], [ %tokens.next, %body ]
+  %c = load i8, ptr %p, align 1
+  %end = icmp eq i8 %c, 0
+  br i1 %end, label %exit, label %body
+
+body:
+  %state.next = call i32 @tokenize_state(i32 %state, i8 %c)
+  %was = icmp eq i32 %state, 0
+  %is = icmp ne i32 %state.next, 0
+  %starts = and i1 %was, %is
+  %inc = zext i1 %starts to i32
+  %tokens.next = add i32 %tokens, %inc
+  %p.next = getelementptr inbounds i8, ptr %p, i64 1
+  br label %loop
+
+exit:
+  ret i32 %tokens
+}
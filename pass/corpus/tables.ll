@@ -0,0 +1,300 @@
+; Constant tables: lookup tables, string tables and dispatch tables, as found
+; in codecs, parsers and interpreters.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct.keyword = type { ptr, i32, i32 }
+%struct.opcode = type { ptr, ptr, i8, i8 }
+
+@crc32_table = internal unnamed_addr constant [256 x i32] [i32 0, i32 1996959894, i32 -301047508, i32 -1727442502, i32 124634137, i32 1886057615, i32 -379345611, i32 -1637575261, i32 249268274, i32 2044508324, i32 -522852066, i32 -1747789432, i32 162941995, i32 2125561021, i32 -407360249, i32 -1866523247, i32 498536548, i32 1789927666, i32 -205950648, i32 -2067906082, i32 450548861, i32 1843258603, i32 -187386543, i32 -2083289657, i32 325883990, i32 1684777152, i32 -43845254, i32 -1973040660, i32 335633487, i32 1661365465, i32 -99664541, i32 -1928851979, i32 997073096, i32 1281953886, i32 -715111964, i32 -1570279054, i32 1006888145, i32 1258607687, i32 -770865667, i32 -1526024853, i32 901097722, i32 1119000684, i32 -608450090, i32 -1396901568, i32 853044451, i32 1172266101, i32 -589951537, i32 -1412350631, i32 651767980, i32 1373503546, i32 -925412992, i32 -1076862698, i32 565507253, i32 1454621731, i32 -809855591, i32 -1195530993, i32 671266974, i32 1594198024, i32 -972236366, i32 -1324619484, i32 795835527, i32 1483230225, i32 -1050600021, i32 -1234817731, i32 1994146192, i32 31158534, i32 -1731059524, i32 -271249366, i32 1907459465, i32 112637215, i32 -1614814043, i32 -390540237, i32 2013776290, i32 251722036, i32 -1777751922, i32 -519137256, i32 2137656763, i32 141376813, i32 -1855689577, i32 -429695999, i32 1802195444, i32 476864866, i32 -2056965928, i32 -228458418, i32 1812370925, i32 453092731, i32 -2113342271, i32 -183516073, i32 1706088902, i32 314042704, i32 -1950435094, i32 -54949764, i32 1658658271, i32 366619977, i32 -1932296973, i32 -69972891, i32 1303535960, i32 984961486, i32 -1547960204, i32 -725929758, i32 1256170817, i32 1037604311, i32 -1529756563, i32 -740887301, i32 1131014506, i32 879679996, i32 -1385723834, i32 -631195440, i32 1141124467, i32 855842277, i32 -1442165665, i32 -586318647, i32 1342533948, i32 654459306, i32 -1106571248, i32 -921952122, i32 1466479909, i32 544179635, i32 -1184443383, i32 -832445281, i32 1591671054, i32 702138776, i32 -1328506846, i32 -942167884, i32 1504918807, i32 783551873, i32 -1212326853, i32 -1061524307, i32 -306674912, i32 -1698712650, i32 62317068, i32 1957810842, i32 -355121351, i32 -1647151185, i32 81470997, i32 1943803523, i32 -480048366, i32 -1805370492, i32 225274430, i32 2053790376, i32 -468791541, i32 -1828061283, i32 167816743, i32 2097651377, i32 -267414716, i32 -2029476910, i32 503444072, i32 1762050814, i32 -144550051, i32 -2140837941, i32 426522225, i32 1852507879, i32 -19653770, i32 -1982649376, i32 282753626, i32 1742555852, i32 -105259153, i32 -1900089351, i32 397917763, i32 1622183637, i32 -690576408, i32 -1580100738, i32 953729732, i32 1340076626, i32 -776247311, i32 -1497606297, i32 1068828381, i32 1219638859, i32 -670225446, i32 -1358292148, i32 906185462, i32 1090812512, i32 -547295293, i32 -1469587627, i32 829329135, i32 1181335161, i32 -882789492, i32 -1134132454, i32 628085408, i32 1382605366, i32 -871598187, i32 -1156888829, i32 570562233, i32 1426400815, i32 -977650754, i32 -1296233688, i32 733239954, i32 1555261956, i32 -1026031705, i32 -1244606671, i32 752459403, i32 1541320221, i32 -1687895376, i32 -328994266, i32 1969922972, i32 40735498, i32 -1677130071, i32 -351390145, i32 1913087877, i32 83908371, i32 -1782625662, i32 -491226604, i32 2075208622, i32 213261112, i32 -1831694693, i32 -438977011, i32 2094854071, i32 198958881, i32 -2032938284, i32 -237706686, i32 1759359992, i32 534414190, i32 -2118248755, i32 -155638181, i32 1873836001, i32 414664567, i32 -2012718362, i32 -15766928, i32 1711684554, i32 285281116, i32 -1889165569, i32 -127750551, i32 1634467795, i32 376229701, i32 -1609899400, i32 -686959890, i32 1308918612, i32 956543938, i32 -1486412191, i32 -799009033, i32 1231636301, i32 1047427035, i32 -1362007478, i32 -640263460, i32 1088359270, i32 936918000, i32 -1447252397, i32 -558129467, i32 1202900863, i32 817233897, i32 -1111625188, i32 -893730166, i32 1404277552, i32 615818150, i32 -1160759803, i32 -841546093, i32 1423857449, i32 601450431, i32 -1285129682, i32 -1000256840, i32 1567103746, i32 711928724, i32 -1274298825, i32 -1022587231, i32 1510334235, i32 755167117], align 16
+@sine_table = dso_local local_unnamed_addr constant [256 x double] [double 0x0000000000000000, double 0x3F992155F7A3667E, double 0x3FA91F65F10DD814, double 0x3FB2D52092CE19F6, double 0x3FB917A6BC29B42C, double 0x3FBF564E56A9730E, double 0x3FC2C8106E8E613A, double 0x3FC5E214448B3FC6, double 0x3FC8F8B83C69A60A, double 0x3FCC0B826A7E4F63, double 0x3FCF19F97B215F1A, double 0x3FD111D262B1F677, double 0x3FD294062ED59F05, double 0x3FD4135C94176602, double 0x3FD58F9A75AB1FDD, double 0x3FD7088530FA459E, double 0x3FD87DE2A6AEA963, double 0x3FD9EF7943A8ED8A, double 0x3FDB5D1009E15CC0, double 0x3FDCC66E9931C45D, double 0x3FDE2B5D3806F63B, double 0x3FDF8BA4DBF89ABA, double 0x3FE073879922FFED, double 0x3FE11EB3541B4B22, double 0x3FE1C73B39AE68C8, double 0x3FE26D054CDD12DF, double 0x3FE30FF7FCE17035, double 0x3FE3AFFA292050B9, double 0x3FE44CF325091DD6, double 0x3FE4E6CABBE3E5E9, double 0x3FE57D69348CEC9F, double 0x3FE610B7551D2CDE, double 0x3FE6A09E667F3BCC, double 0x3FE72D0837EFFF96, double 0x3FE7B5DF226AAFAF, double 0x3FE83B0E0BFF976D, double 0x3FE8BC806B151741, double 0x3FE93A22499263FB, double 0x3FE9B3E047F38740, double 0x3FEA29A7A0462782, double 0x3FEA9B66290EA1A3, double 0x3FEB090A581501FF, double 0x3FEB728345196E3E, double 0x3FEBD7C0AC6F9529, double 0x3FEC38B2F180BDB0, double 0x3FEC954B213411F5, double 0x3FECED7AF43CC773, double 0x3FED4134D14DC93A, double 0x3FED906BCF328D46, double 0x3FEDDB13B6CCC23C, double 0x3FEE212104F686E5, double 0x3FEE6288EC48E112, double 0x3FEE9F4156C62DDB, double 0x3FEED740E7684963, double 0x3FEF0A7EFB9230D7, double 0x3FEF38F3AC64E589, double 0x3FEF6297CFF75CB0, double 0x3FEF8764FA714BA9, double 0x3FEFA7557F08A517, double 0x3FEFC26470E19FD3, double 0x3FEFD88DA3D12525, double 0x3FEFE9CDAD01883A, double 0x3FEFF621E3796D7E, double 0x3FEFFD886084CD0D, double 0x3FF0000000000000, double 0x3FEFFD886084CD0D, double 0x3FEFF621E3796D7E, double 0x3FEFE9CDAD01883A, double 0x3FEFD88DA3D12526, double 0x3FEFC26470E19FD3, double 0x3FEFA7557F08A517, double 0x3FEF8764FA714BA9, double 0x3FEF6297CFF75CB0, double 0x3FEF38F3AC64E589, double 0x3FEF0A7EFB9230D7, double 0x3FEED740E7684963, double 0x3FEE9F4156C62DDB, double 0x3FEE6288EC48E112, double 0x3FEE212104F686E5, double 0x3FEDDB13B6CCC23C, double 0x3FED906BCF328D46, double 0x3FED4134D14DC93A, double 0x3FECED7AF43CC774, double 0x3FEC954B213411F4, double 0x3FEC38B2F180BDB1, double 0x3FEBD7C0AC6F952A, double 0x3FEB728345196E3E, double 0x3FEB090A58150201, double 0x3FEA9B66290EA1A5, double 0x3FEA29A7A0462782, double 0x3FE9B3E047F38741, double 0x3FE93A22499263FC, double 0x3FE8BC806B151742, double 0x3FE83B0E0BFF976F, double 0x3FE7B5DF226AAFAE, double 0x3FE72D0837EFFF96, double 0x3FE6A09E667F3BCD, double 0x3FE610B7551D2CE0, double 0x3FE57D69348CECA1, double 0x3FE4E6CABBE3E5E8, double 0x3FE44CF325091DD6, double 0x3FE3AFFA292050BA, double 0x3FE30FF7FCE17036, double 0x3FE26D054CDD12E0, double 0x3FE1C73B39AE68C8, double 0x3FE11EB3541B4B22, double 0x3FE073879922FFEE, double 0x3FDF8BA4DBF89ABC, double 0x3FDE2B5D3806F63F, double 0x3FDCC66E9931C463, double 0x3FDB5D1009E15CBF, double 0x3FD9EF7943A8ED8B, double 0x3FD87DE2A6AEA965, double 0x3FD7088530FA45A2, double 0x3FD58F9A75AB1FE2, double 0x3FD4135C94176600, double 0x3FD294062ED59F06, double 0x3FD111D262B1F679, double 0x3FCF19F97B215F21, double 0x3FCC0B826A7E4F6C, double 0x3FC8F8B83C69A617, double 0x3FC5E214448B3FC6, double 0x3FC2C8106E8E613C, double 0x3FBF564E56A97319, double 0x3FB917A6BC29B43C, double 0x3FB2D52092CE1A0C, double 0x3FA91F65F10DD80D, double 0x3F992155F7A36689, double 0x3CA1A62633145C07, double 0xBF992155F7A36642, double 0xBFA91F65F10DD7EA, double 0xBFB2D52092CE19FB, double 0xBFB917A6BC29B42B, double 0xBFBF564E56A97307, double 0xBFC2C8106E8E6134, double 0xBFC5E214448B3FBD, double 0xBFC8F8B83C69A60E, double 0xBFCC0B826A7E4F63, double 0xBFCF19F97B215F18, double 0xBFD111D262B1F675, double 0xBFD294062ED59F01, double 0xBFD4135C941765FC, double 0xBFD58F9A75AB1FDE, double 0xBFD7088530FA459E, double 0xBFD87DE2A6AEA961, double 0xBFD9EF7943A8ED87, double 0xBFDB5D1009E15CBB, double 0xBFDCC66E9931C45F, double 0xBFDE2B5D3806F63B, double 0xBFDF8BA4DBF89AB8, double 0xBFE073879922FFEC, double 0xBFE11EB3541B4B20, double 0xBFE1C73B39AE68C6, double 0xBFE26D054CDD12DF, double 0xBFE30FF7FCE17034, double 0xBFE3AFFA292050B8, double 0xBFE44CF325091DD4, double 0xBFE4E6CABBE3E5E7, double 0xBFE57D69348CECA0, double 0xBFE610B7551D2CDE, double 0xBFE6A09E667F3BCC, double 0xBFE72D0837EFFF95, double 0xBFE7B5DF226AAFAD, double 0xBFE83B0E0BFF976B, double 0xBFE8BC806B15173E, double 0xBFE93A22499263F8, double 0xBFE9B3E047F38742, double 0xBFEA29A7A0462783, double 0xBFEA9B66290EA1A3, double 0xBFEB090A581501FF, double 0xBFEB728345196E3D, double 0xBFEBD7C0AC6F9529, double 0xBFEC38B2F180BDB0, double 0xBFEC954B213411F4, double 0xBFECED7AF43CC771, double 0xBFED4134D14DC938, double 0xBFED906BCF328D44, double 0xBFEDDB13B6CCC23D, double 0xBFEE212104F686E5, double 0xBFEE6288EC48E112, double 0xBFEE9F4156C62DDA, double 0xBFEED740E7684963, double 0xBFEF0A7EFB9230D7, double 0xBFEF38F3AC64E588, double 0xBFEF6297CFF75CAF, double 0xBFEF8764FA714BA8, double 0xBFEFA7557F08A516, double 0xBFEFC26470E19FD4, double 0xBFEFD88DA3D12526, double 0xBFEFE9CDAD01883A, double 0xBFEFF621E3796D7E, double 0xBFEFFD886084CD0D, double 0xBFF0000000000000, double 0xBFEFFD886084CD0D, double 0xBFEFF621E3796D7E, double 0xBFEFE9CDAD01883A, double 0xBFEFD88DA3D12526, double 0xBFEFC26470E19FD4, double 0xBFEFA7557F08A516, double 0xBFEF8764FA714BA9, double 0xBFEF6297CFF75CB0, double 0xBFEF38F3AC64E589, double 0xBFEF0A7EFB9230D7, double 0xBFEED740E7684964, double 0xBFEE9F4156C62DDB, double 0xBFEE6288EC48E113, double 0xBFEE212104F686E6, double 0xBFEDDB13B6CCC23E, double 0xBFED906BCF328D45, double 0xBFED4134D14DC939, double 0xBFECED7AF43CC773, double 0xBFEC954B213411F5, double 0xBFEC38B2F180BDB1, double 0xBFEBD7C0AC6F952A, double 0xBFEB728345196E3F, double 0xBFEB090A58150201, double 0xBFEA9B66290EA1A5, double 0xBFEA29A7A0462785, double 0xBFE9B3E047F38744, double 0xBFE93A22499263FA, double 0xBFE8BC806B151740, double 0xBFE83B0E0BFF976E, double 0xBFE7B5DF226AAFAF, double 0xBFE72D0837EFFF97, double 0xBFE6A09E667F3BCE, double 0xBFE610B7551D2CE1, double 0xBFE57D69348CECA2, double 0xBFE4E6CABBE3E5EC, double 0xBFE44CF325091DDA, double 0xBFE3AFFA292050BE, double 0xBFE30FF7FCE17034, double 0xBFE26D054CDD12DE, double 0xBFE1C73B39AE68C8, double 0xBFE11EB3541B4B23, double 0xBFE073879922FFEF, double 0xBFDF8BA4DBF89ABE, double 0xBFDE2B5D3806F640, double 0xBFDCC66E9931C465, double 0xBFDB5D1009E15CC8, double 0xBFD9EF7943A8ED94, double 0xBFD87DE2A6AEA96E, double 0xBFD7088530FA459C, double 0xBFD58F9A75AB1FDC, double 0xBFD4135C94176602, double 0xBFD294062ED59F08, double 0xBFD111D262B1F67B, double 0xBFCF19F97B215F25, double 0xBFCC0B826A7E4F70, double 0xBFC8F8B83C69A61B, double 0xBFC5E214448B3FDA, double 0xBFC2C8106E8E6151, double 0xBFBF564E56A97302, double 0xBFB917A6BC29B425, double 0xBFB2D52092CE19F5, double 0xBFA91F65F10DD81F, double 0xBF992155F7A366AC], align 16
+@.kw.0 = private unnamed_addr constant [5 x i8] c"auto\00", align 1
+@.kw.1 = private unnamed_addr constant [6 x i8] c"break\00", align 1
+@.kw.2 = private unnamed_addr constant [5 x i8] c"case\00", align 1
+@.kw.3 = private unnamed_addr constant [5 x i8] c"char\00", align 1
+@.kw.4 = private unnamed_addr constant [6 x i8] c"const\00", align 1
+@.kw.5 = private unnamed_addr constant [9 x i8] c"continue\00", align 1
+@.kw.6 = private unnamed_addr constant [8 x i8] c"default\00", align 1
+@.kw.7 = private unnamed_addr constant [3 x i8] c"do\00", align 1
+@.kw.8 = private unnamed_addr constant [7 x i8] c"double\00", align 1
+@.kw.9 = private unnamed_addr constant [5 x i8] c"else\00", align 1
+@.kw.10 = private unnamed_addr constant [5 x i8] c"enum\00", align 1
+@.kw.11 = private unnamed_addr constant [7 x i8] c"extern\00", align 1
+@.kw.12 = private unnamed_addr constant [6 x i8] c"float\00", align 1
+@.kw.13 = private unnamed_addr constant [4 x i8] c"for\00", align 1
+@.kw.14 = private unnamed_addr constant [5 x i8] c"goto\00", align 1
+@.kw.15 = private unnamed_addr constant [3 x i8] c"if\00", align 1
+@.kw.16 = private unnamed_addr constant [7 x i8] c"inline\00", align 1
+@.kw.17 = private unnamed_addr constant [4 x i8] c"int\00", align 1
+@.kw.18 = private unnamed_addr constant [5 x i8] c"long\00", align 1
+@.kw.19 = private unnamed_addr constant [9 x i8] c"register\00", align 1
+@.kw.20 = private unnamed_addr constant [9 x i8] c"restrict\00", align 1
+@.kw.21 = private unnamed_addr constant [7 x i8] c"return\00", align 1
+@.kw.22 = private unnamed_addr constant [6 x i8] c"short\00", align 1
+@.kw.23 = private unnamed_addr constant [7 x i8] c"signed\00", align 1
+@.kw.24 = private unnamed_addr constant [7 x i8] c"sizeof\00", align 1
+@.kw.25 = private unnamed_addr constant [7 x i8] c"static\00", align 1
+@.kw.26 = private unnamed_addr constant [7 x i8] c"struct\00", align 1
+@.kw.27 = private unnamed_addr constant [7 x i8] c"switch\00", align 1
+@.kw.28 = private unnamed_addr constant [8 x i8] c"typedef\00", align 1
+@.kw.29 = private unnamed_addr constant [6 x i8] c"union\00", align 1
+@.kw.30 = private unnamed_addr constant [9 x i8] c"unsigned\00", align 1
+@.kw.31 = private unnamed_addr constant [5 x i8] c"void\00", align 1
+@.kw.32 = private unnamed_addr constant [9 x i8] c"volatile\00", align 1
+@.kw.33 = private unnamed_addr constant [6 x i8] c"while\00", align 1
+@keywords = dso_local constant [34 x %struct.keyword] [%struct.keyword { ptr @.kw.0, i32 4, i32 256 }, %struct.keyword { ptr @.kw.1, i32 5, i32 257 }, %struct.keyword { ptr @.kw.2, i32 4, i32 258 }, %struct.keyword { ptr @.kw.3, i32 4, i32 259 }, %struct.keyword { ptr @.kw.4, i32 5, i32 260 }, %struct.keyword { ptr @.kw.5, i32 8, i32 261 }, %struct.keyword { ptr @.kw.6, i32 7, i32 262 }, %struct.keyword { ptr @.kw.7, i32 2, i32 263 }, %struct.keyword { ptr @.kw.8, i32 6, i32 264 }, %struct.keyword { ptr @.kw.9, i32 4, i32 265 }, %struct.keyword { ptr @.kw.10, i32 4, i32 266 }, %struct.keyword { ptr @.kw.11, i32 6, i32 267 }, %struct.keyword { ptr @.kw.12, i32 5, i32 268 }, %struct.keyword { ptr @.kw.13, i32 3, i32 269 }, %struct.keyword { ptr @.kw.14, i32 4, i32 270 }, %struct.keyword { ptr @.kw.15, i32 2, i32 271 }, %struct.keyword { ptr @.kw.16, i32 6, i32 272 }, %struct.keyword { ptr @.kw.17, i32 3, i32 273 }, %struct.keyword { ptr @.kw.18, i32 4, i32 274 }, %struct.keyword { ptr @.kw.19, i32 8, i32 275 }, %struct.keyword { ptr @.kw.20, i32 8, i32 276 }, %struct.keyword { ptr @.kw.21, i32 6, i32 277 }, %struct.keyword { ptr @.kw.22, i32 5, i32 278 }, %struct.keyword { ptr @.kw.23, i32 6, i32 279 }, %struct.keyword { ptr @.kw.24, i32 6, i32 280 }, %struct.keyword { ptr @.kw.25, i32 6, i32 281 }, %struct.keyword { ptr @.kw.26, i32 6, i32 282 }, %struct.keyword { ptr @.kw.27, i32 6, i32 283 }, %struct.keyword { ptr @.kw.28, i32 7, i32 284 }, %struct.keyword { ptr @.kw.29, i32 5, i32 285 }, %struct.keyword { ptr @.kw.30, i32 8, i32 286 }, %struct.keyword { ptr @.kw.31, i32 4, i32 287 }, %struct.keyword { ptr @.kw.32, i32 8, i32 288 }, %struct.keyword { ptr @.kw.33, i32 5, i32 289 }], align 16
+@.op.0 = private unnamed_addr constant [4 x i8] c"nop\00", align 1
+@.op.1 = private unnamed_addr constant [5 x i8] c"push\00", align 1
+@.op.2 = private unnamed_addr constant [4 x i8] c"pop\00", align 1
+@.op.3 = private unnamed_addr constant [4 x i8] c"add\00", align 1
+@.op.4 = private unnamed_addr constant [4 x i8] c"sub\00", align 1
+@.op.5 = private unnamed_addr constant [4 x i8] c"mul\00", align 1
+@.op.6 = private unnamed_addr constant [4 x i8] c"div\00", align 1
+@.op.7 = private unnamed_addr constant [4 x i8] c"jmp\00", align 1
+@.op.8 = private unnamed_addr constant [3 x i8] c"jz\00", align 1
+@.op.9 = private unnamed_addr constant [5 x i8] c"call\00", align 1
+@.op.10 = private unnamed_addr constant [4 x i8] c"ret\00", align 1
+@.op.11 = private unnamed_addr constant [5 x i8] c"halt\00", align 1
+@opcodes = internal constant [12 x %struct.opcode] [%struct.opcode { ptr @.op.0, ptr @op_nop, i8 0, i8 0 }, %struct.opcode { ptr @.op.1, ptr @op_push, i8 1, i8 1 }, %struct.opcode { ptr @.op.2, ptr @op_pop, i8 2, i8 2 }, %struct.opcode { ptr @.op.3, ptr @op_add, i8 3, i8 0 }, %struct.opcode { ptr @.op.4, ptr @op_sub, i8 4, i8 1 }, %struct.opcode { ptr @.op.5, ptr @op_mul, i8 5, i8 2 }, %struct.opcode { ptr @.op.6, ptr @op_div, i8 6, i8 0 }, %struct.opcode { ptr @.op.7, ptr @op_jmp, i8 7, i8 1 }, %struct.opcode { ptr @.op.8, ptr @op_jz, i8 8, i8 2 }, %struct.opcode { ptr @.op.9, ptr @op_call, i8 9, i8 0 }, %struct.opcode { ptr @.op.10, ptr @op_ret, i8 10, i8 1 }, %struct.opcode { ptr @.op.11, ptr @op_halt, i8 11, i8 2 }], align 16
+@quant_matrix = dso_local constant [16 x [16 x i16]] [[16 x i16] [i16 16, i16 21, i16 26, i16 31, i16 36, i16 41, i16 46, i16 51, i16 56, i16 61, i16 66, i16 71, i16 76, i16 17, i16 22, i16 27], [16 x i16] [i16 19, i16 24, i16 29, i16 34, i16 39, i16 44, i16 49, i16 54, i16 59, i16 64, i16 69, i16 74, i16 79, i16 20, i16 25, i16 30], [16 x i16] [i16 22, i16 27, i16 32, i16 37, i16 42, i16 47, i16 52, i16 57, i16 62, i16 67, i16 72, i16 77, i16 18, i16 23, i16 28, i16 33], [16 x i16] [i16 25, i16 30, i16 35, i16 40, i16 45, i16 50, i16 55, i16 60, i16 65, i16 70, i16 75, i16 16, i16 21, i16 26, i16 31, i16 36], [16 x i16] [i16 28, i16 33, i16 38, i16 43, i16 48, i16 53, i16 58, i16 63, i16 68, i16 73, i16 78, i16 19, i16 24, i16 29, i16 34, i16 39], [16 x i16] [i16 31, i16 36, i16 41, i16 46, i16 51, i16 56, i16 61, i16 66, i16 71, i16 76, i16 17, i16 22, i16 27, i16 32, i16 37, i16 42], [16 x i16] [i16 34, i16 39, i16 44, i16 49, i16 54, i16 59, i16 64, i16 69, i16 74, i16 79, i16 20, i16 25, i16 30, i16 35, i16 40, i16 45], [16 x i16] [i16 37, i16 42, i16 47, i16 52, i16 57, i16 62, i16 67, i16 72, i16 77, i16 18, i16 23, i16 28, i16 33, i16 38, i16 43, i16 48], [16 x i16] [i16 40, i16 45, i16 50, i16 55, i16 60, i16 65, i16 70, i16 75, i16 16, i16 21, i16 26, i16 31, i16 36, i16 41, i16 46, i16 51], [16 x i16] [i16 43, i16 48, i16 53, i16 58, i16 63, i16 68, i16 73, i16 78, i16 19, i16 24, i16 29, i16 34, i16 39, i16 44, i16 49, i16 54], [16 x i16] [i16 46, i16 51, i16 56, i16 61, i16 66, i16 71, i16 76, i16 17, i16 22, i16 27, i16 32, i16 37, i16 42, i16 47, i16 52, i16 57], [16 x i16] [i16 49, i16 54, i16 59, i16 64, i16 69, i16 74, i16 79, i16 20, i16 25, i16 30, i16 35, i16 40, i16 45, i16 50, i16 55, i16 60], [16 x i16] [i16 52, i16 57, i16 62, i16 67, i16 72, i16 77, i16 18, i16 23, i16 28, i16 33, i16 38, i16 43, i16 48, i16 53, i16 58, i16 63], [16 x i16] [i16 55, i16 60, i16 65, i16 70, i16 75, i16 16, i16 21, i16 26, i16 31, i16 36, i16 41, i16 46, i16 51, i16 56, i16 61, i16 66], [16 x i16] [i16 58, i16 63, i16 68, i16 73, i16 78, i16 19, i16 24, i16 29, i16 34, i16 39, i16 44, i16 49, i16 54, i16 59, i16 64, i16 69], [16 x i16] [i16 61, i16 66, i16 71, i16 76, i16 17, i16 22, i16 27, i16 32, i16 37, i16 42, i16 47, i16 52, i16 57, i16 62, i16 67, i16 72]], align 16
+@zigzag = internal constant [64 x i8] c"\00\25\0A\2F\14\39\1E\03\28\0D\32\17\3C\21\06\2B\10\35\1A\3F\24\09\2E\13\38\1D\02\27\0C\31\16\3B\20\05\2A\0F\34\19\3E\23\08\2D\12\37\1C\01\26\0B\30\15\3A\1F\04\29\0E\33\18\3D\22\07\2C\11\36\1B", align 16
+@vm_sp = internal global i32 0, align 4
+@vm_stack = internal global [256 x i64] zeroinitializer, align 16
+
+declare i32 @strcmp(ptr, ptr)
+
+define dso_local i32 @crc32(ptr %buf, i64 %len) {
+entry:
+  %empty = icmp eq i64 %len, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %crc = phi i32 [ -1, %entry ], [ %crc.next, %loop ]
+  %p = getelementptr inbounds i8, ptr %buf, i64 %i
+  %b = load i8, ptr %p, align 1
+  %b32 = zext i8 %b to i32
+  %x = xor i32 %crc, %b32
+  %idx = and i32 %x, 255
+  %idx64 = zext i32 %idx to i64
+  %tp = getelementptr inbounds [256 x i32], ptr @crc32_table, i64 0, i64 %idx64
+  %t = load i32, ptr %tp, align 4
+  %sh = lshr i32 %crc, 8
+  %crc.next = xor i32 %t, %sh
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %len
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %res = phi i32 [ -1, %entry ], [ %crc.next, %loop ]
+  %inv = xor i32 %res, -1
+  ret i32 %inv
+}
+
+define dso_local double @fast_sin(double %x) {
+entry:
+  %scaled = fmul double %x, 0x4044600000000000
+  %idx = fptosi double %scaled to i32
+  %masked = and i32 %idx, 255
+  %idx64 = zext i32 %masked to i64
+  %p = getelementptr inbounds [256 x double], ptr @sine_table, i64 0, i64 %idx64
+  %v = load double, ptr %p, align 8
+  ret double %v
+}
+
+define dso_local i32 @lookup_keyword(ptr %s) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %next ]
+  %namep = getelementptr inbounds [34 x %struct.keyword], ptr @keywords, i64 0, i64 %i, i32 0
+  %name = load ptr, ptr %namep, align 8
+  %cmp = call i32 @strcmp(ptr %name, ptr %s)
+  %eq = icmp eq i32 %cmp, 0
+  br i1 %eq, label %found, label %next
+
+next:
+  %i.next = add nuw nsw i64 %i, 1
+  %done = icmp eq i64 %i.next, 34
+  br i1 %done, label %exit, label %loop
+
+found:
+  %tokp = getelementptr inbounds [34 x %struct.keyword], ptr @keywords, i64 0, i64 %i, i32 2
+  %tok = load i32, ptr %tokp, align 4
+  ret i32 %tok
+
+exit:
+  ret i32 -1
+}
+
+define dso_local void @quantize(ptr %block) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %zp = getelementptr inbounds [64 x i8], ptr @zigzag, i64 0, i64 %i
+  %z = load i8, ptr %zp, align 1
+  %z64 = zext i8 %z to i64
+  %row = lshr i64 %z64, 3
+  %col = and i64 %z64, 7
+  %qp = getelementptr inbounds [16 x [16 x i16]], ptr @quant_matrix, i64 0, i64 %row, i64 %col
+  %q = load i16, ptr %qp, align 2
+  %q32 = sext i16 %q to i32
+  %bp = getelementptr inbounds i32, ptr %block, i64 %z64
+  %b = load i32, ptr %bp, align 4
+  %d = sdiv i32 %b, %q32
+  store i32 %d, ptr %bp, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done = icmp eq i64 %i.next, 64
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define internal i32 @op_nop(i64 %arg) {
+entry:
+  ret i32 0
+}
+
+define internal i32 @op_push(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %sp64 = sext i32 %sp to i64
+  %slot = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %sp64
+  store i64 %arg, ptr %slot, align 8
+  %sp.next = add nsw i32 %sp, 1
+  store i32 %sp.next, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_pop(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %sp.next = add nsw i32 %sp, -1
+  store i32 %sp.next, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_add(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %top = add nsw i32 %sp, -1
+  %below = add nsw i32 %sp, -2
+  %top64 = sext i32 %top to i64
+  %below64 = sext i32 %below to i64
+  %tp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %top64
+  %bp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %below64
+  %a = load i64, ptr %bp, align 8
+  %b = load i64, ptr %tp, align 8
+  %r = add nsw i64 %a, %b
+  store i64 %r, ptr %bp, align 8
+  store i32 %top, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_sub(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %top = add nsw i32 %sp, -1
+  %below = add nsw i32 %sp, -2
+  %top64 = sext i32 %top to i64
+  %below64 = sext i32 %below to i64
+  %tp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %top64
+  %bp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %below64
+  %a = load i64, ptr %bp, align 8
+  %b = load i64, ptr %tp, align 8
+  %r = sub nsw i64 %a, %b
+  store i64 %r, ptr %bp, align 8
+  store i32 %top, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_mul(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %top = add nsw i32 %sp, -1
+  %below = add nsw i32 %sp, -2
+  %top64 = sext i32 %top to i64
+  %below64 = sext i32 %below to i64
+  %tp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %top64
+  %bp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %below64
+  %a = load i64, ptr %bp, align 8
+  %b = load i64, ptr %tp, align 8
+  %r = mul nsw i64 %a, %b
+  store i64 %r, ptr %bp, align 8
+  store i32 %top, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_div(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %top = add nsw i32 %sp, -1
+  %below = add nsw i32 %sp, -2
+  %top64 = sext i32 %top to i64
+  %below64 = sext i32 %below to i64
+  %tp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %top64
+  %bp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %below64
+  %a = load i64, ptr %bp, align 8
+  %b = load i64, ptr %tp, align 8
+  %r = sdiv i64 %a, %b
+  store i64 %r, ptr %bp, align 8
+  store i32 %top, ptr @vm_sp, align 4
+  ret i32 0
+}
+
+define internal i32 @op_jmp(i64 %arg) {
+entry:
+  %t = trunc i64 %arg to i32
+  ret i32 %t
+}
+
+define internal i32 @op_jz(i64 %arg) {
+entry:
+  %sp = load i32, ptr @vm_sp, align 4
+  %top = add nsw i32 %sp, -1
+  store i32 %top, ptr @vm_sp, align 4
+  %top64 = sext i32 %top to i64
+  %tp = getelementptr inbounds [256 x i64], ptr @vm_stack, i64 0, i64 %top64
+  %v = load i64, ptr %tp, align 8
+  %z = icmp eq i64 %v, 0
+  %t = trunc i64 %arg to i32
+  %r = select i1 %z, i32 %t, i32 0
+  ret i32 %r
+}
+
+define internal i32 @op_call(i64 %arg) {
+entry:
+  %t = trunc i64 %arg to i32
+  ret i32 %t
+}
+
+define internal i32 @op_ret(i64 %arg) {
+entry:
+  ret i32 0
+}
+
+define internal i32 @op_halt(i64 %arg) {
+entry:
+  ret i32 -1
+}
+
+define dso_local i32 @vm_step(i8 %op, i64 %arg) {
+entry:
+  %op64 = zext i8 %op to i64
+  %valid = icmp ult i8 %op, 12
+  br i1 %valid, label %dispatch, label %bad
+
+dispatch:
+  %fp = getelementptr inbounds [12 x %struct.opcode], ptr @opcodes, i64 0, i64 %op64, i32 1
+  %f = load ptr, ptr %fp, align 8
+  %r = call i32 %f(i64 %arg)
+  ret i32 %r
+
+bad:
+  ret i32 -2
+}
@@ -0,0 +1,131 @@
+; Vectorized and floating-point code: SIMD arithmetic, shuffles, reductions,
+; fast-math flags, intrinsics and atomics, as emitted for numeric kernels.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@counter = dso_local global i64 0, align 8
+@lock = internal global i32 0, align 4
+
+declare <4 x float> @llvm.fma.v4f32(<4 x float>, <4 x float>, <4 x float>)
+declare float @llvm.vector.reduce.fadd.v4f32(float, <4 x float>)
+declare i32 @llvm.vector.reduce.add.v8i32(<8 x i32>)
+declare <8 x i32> @llvm.smax.v8i32(<8 x i32>, <8 x i32>)
+declare <4 x float> @llvm.masked.load.v4f32.p0(ptr, i32, <4 x i1>, <4 x float>)
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1)
+declare float @llvm.sqrt.f32(float)
+
+define dso_local void @saxpy(ptr noalias %y, ptr noalias %x, float %a, i64 %n) {
+entry:
+  %ins = insertelement <4 x float> poison, float %a, i64 0
+  %splat = shufflevector <4 x float> %ins, <4 x float> poison, <4 x i32> zeroinitializer
+  %nvec = and i64 %n, -4
+  %any = icmp ne i64 %nvec, 0
+  br i1 %any, label %vloop, label %tail
+
+vloop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %vloop ]
+  %xp = getelementptr inbounds float, ptr %x, i64 %i
+  %yp = getelementptr inbounds float, ptr %y, i64 %i
+  %xv = load <4 x float>, ptr %xp, align 4
+  %yv = load <4 x float>, ptr %yp, align 4
+  %r = call fast <4 x float> @llvm.fma.v4f32(<4 x float> %splat, <4 x float> %xv, <4 x float> %yv)
+  store <4 x float> %r, ptr %yp, align 4
+  %i.next = add nuw i64 %i, 4
+  %done = icmp eq i64 %i.next, %nvec
+  br i1 %done, label %tail, label %vloop
+
+tail:
+  %rest = and i64 %n, 3
+  %lane = insertelement <4 x i64> poison, i64 %rest, i64 0
+  %lanes = shufflevector <4 x i64> %lane, <4 x i64> poison, <4 x i32> zeroinitializer
+  %mask = icmp ugt <4 x i64> %lanes, <i64 0, i64 1, i64 2, i64 3>
+  %xt = getelementptr inbounds float, ptr %x, i64 %nvec
+  %xr = call <4 x float> @llvm.masked.load.v4f32.p0(ptr %xt, i32 4, <4 x i1> %mask, <4 x float> zeroinitializer)
+  %sum = call reassoc nsz float @llvm.vector.reduce.fadd.v4f32(float -0.000000e+00, <4 x float> %xr)
+  %yt = getelementptr inbounds float, ptr %y, i64 %nvec
+  %yv0 = load float, ptr %yt, align 4
+  %m = fmul contract float %sum, %a
+  %yn = fadd contract float %yv0, %m
+  store float %yn, ptr %yt, align 4
+  ret void
+}
+
+define dso_local float @norm(ptr %v) {
+entry:
+  %x = load <4 x float>, ptr %v, align 16
+  %sq = fmul nnan ninf <4 x float> %x, %x
+  %hi = shufflevector <4 x float> %sq, <4 x float> undef, <4 x i32> <i32 2, i32 3, i32 undef, i32 undef>
+  %s1 = fadd nnan ninf <4 x float> %sq, %hi
+  %e0 = extractelement <4 x float> %s1, i64 0
+  %e1 = extractelement <4 x float> %s1, i64 1
+  %s = fadd nnan ninf float %e0, %e1
+  %r = call afn float @llvm.sqrt.f32(float %s)
+  ret float %r
+}
+
+define dso_local i32 @clamped_sum(ptr %p) {
+entry:
+  %v = load <8 x i32>, ptr %p, align 32
+  %c = call <8 x i32> @llvm.smax.v8i32(<8 x i32> %v, <8 x i32> zeroinitializer)
+  %lt = icmp slt <8 x i32> %c, <i32 255, i32 255, i32 255, i32 255, i32 255, i32 255, i32 255, i32 255>
+  %clamped = select <8 x i1> %lt, <8 x i32> %c, <8 x i32> <i32 255, i32 255, i32 255, i32 255, i32 255, i32 255, i32 255, i32 255>
+  %r = call i32 @llvm.vector.reduce.add.v8i32(<8 x i32> %clamped)
+  ret i32 %r
+}
+
+define dso_local <2 x i64> @widen(<4 x i16> %a) {
+entry:
+  %lo = shufflevector <4 x i16> %a, <4 x i16> poison, <2 x i32> <i32 0, i32 2>
+  %w = sext <2 x i16> %lo to <2 x i64>
+  %s = shl nsw <2 x i64> %w, <i64 3, i64 3>
+  %b = bitcast <4 x i16> %a to i64
+  %ins = insertelement <2 x i64> %s, i64 %b, i64 1
+  ret <2 x i64> %ins
+}
+
+define dso_local void @clear(ptr %buf, i64 %len) {
+entry:
+  call void @llvm.memset.p0.i64(ptr align 16 %buf, i8 0, i64 %len, i1 false)
+  ret void
+}
+
+define dso_local i64 @next_id() {
+entry:
+  %old = atomicrmw add ptr @counter, i64 1 seq_cst, align 8
+  ret i64 %old
+}
+
+define dso_local void @spin_lock() {
+entry:
+  br label %retry
+
+retry:
+  %pair = cmpxchg weak ptr @lock, i32 0, i32 1 acquire monotonic, align 4
+  %ok = extractvalue { i32, i1 } %pair, 1
+  br i1 %ok, label %locked, label %retry
+
+locked:
+  ret void
+}
+
+define dso_local void @spin_unlock() {
+entry:
+  store atomic i32 0, ptr @lock release, align 4
+  fence syncscope("singlethread") seq_cst
+  ret void
+}
+
+define dso_local i32 @saturating(i32 %a, i32 %b) {
+entry:
+  %pair = call { i32, i1 } @llvm.sadd.with.overflow.i32(i32 %a, i32 %b)
+  %sum = extractvalue { i32, i1 } %pair, 0
+  %ovf = extractvalue { i32, i1 } %pair, 1
+  %neg = icmp slt i32 %a, 0
+  %lim = select i1 %neg, i32 -2147483648, i32 2147483647
+  %r = select i1 %ovf, i32 %lim, i32 %sum
+  %f = freeze i32 %r
+  ret i32 %f
+}
+
+declare { i32, i1 } @llvm.sadd.with.overflow.i32(i32, i32)
@@ -0,0 +1,152 @@
+#ifndef IRHASH_DAEMON_HPP
+#define IRHASH_DAEMON_HPP
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Twine.h>
+
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+/// Connection to irhashd, the optional cache daemon.
+///
+/// The daemon keeps the index of the cache in memory and listens on a
+/// SOCK_SEQPACKET Unix socket, so every message is a single datagram:
+///
+///   LOOKUP <algorithm> <key>  ->  HIT <suffix> + fd | MISS | MISMATCH
+///   STORE <key> + fd          (no reply)
+///
+/// Cache entries and object files are passed as open file descriptors
+/// (SCM_RIGHTS). A hit stays usable even if the entry is evicted before the
+/// compiler exits, and the daemon can store an object file long after the
+/// compiler has exited and the build has replaced it.
+struct DaemonClient {
+  static constexpr size_t MaxMessage = 256;
+
+  int sock = -1;
+
+  /// Connect to the daemon listening on \p path.
+  /// Doesn't wait longer than a second for a reply, so a stuck daemon just
+  /// makes the pass use the cache directory directly.
+  bool connect(const char *path) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+      return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+      return false;
+    }
+    struct timeval timeout = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  bool connected() const { return sock >= 0; }
+
+  void disconnect() {
+    close(sock);
+    sock = -1;
+  }
+
+  enum Reply { Error, Miss, Hit, Mismatch };
+
+  /// Ask the daemon for the entry of \p key.
+  /// On a hit, \p entryfd is an open descriptor of the entry and \p suffix
+  /// its file name suffix (`.o` or `.o.zst`).
+  Reply lookup(StringRef algorithm, StringRef key, int &entryfd, std::string &suffix) {
+    if (!send_message(sock, ("LOOKUP " + algorithm + " " + key).str())) {
+      return Error;
+    }
+    char buf[MaxMessage];
+    ssize_t n = receive_message(sock, buf, sizeof(buf), &entryfd);
+    if (n <= 0) {
+      return Error;
+    }
+    StringRef reply(buf, n);
+    if (reply == "MISS") {
+      return Miss;
+    }
+    if (reply == "MISMATCH") {
+      return Mismatch;
+    }
+    if (reply.consume_front("HIT ") && entryfd >= 0) {
+      suffix = reply.str();
+      return Hit;
+    }
+    if (entryfd >= 0) {
+      close(entryfd);
+    }
+    return Error;
+  }
+
+  /// Hand the object file \p objectfile over to the daemon, which stores it
+  /// as the entry of \p key in the background.
+  bool store(StringRef key, const char *objectfile) {
+    int fd = open(objectfile, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    bool ok = send_message(sock, ("STORE " + key).str(), fd);
+    close(fd);
+    return ok;
+  }
+
+  /// Send \p msg and, if \p fd isn't -1, a duplicate of the descriptor \p fd.
+  static bool send_message(int sock, const std::string &msg, int fd = -1) {
+    struct iovec iov = {(void *)msg.data(), msg.size()};
+    struct msghdr hdr = {};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+      hdr.msg_control = control;
+      hdr.msg_controllen = sizeof(control);
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    // A dead daemon must not kill the compiler with SIGPIPE
+    return sendmsg(sock, &hdr, MSG_NOSIGNAL) == (ssize_t)msg.size();
+  }
+
+  /// Receive a message into \p buf.
+  /// \p fd is set to the descriptor passed along with it, or -1.
+  /// Returns the length of the message, 0 at the end of the connection or -1.
+  static ssize_t receive_message(int sock, char *buf, size_t len, int *fd) {
+    struct iovec iov = {buf, len};
+    struct msghdr hdr = {};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    *fd = -1;
+    ssize_t n = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); n >= 0 && cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+      }
+    }
+    return n;
+  }
+};
+
+#endif // IRHASH_DAEMON_HPP
@@ -1,8 +1,15 @@
 #ifndef IRHASH_HASH_HPP
 #define IRHASH_HASH_HPP
 
+// The state of the hash backends lives inside the Hasher
+#define XXH_STATIC_LINKING_ONLY
 #include "xxhash.h"
+#ifdef HASH_BLAKE3
+#include "blake3.h"
+#endif
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 
 #include <llvm/ADT/SmallString.h>
@@ -11,48 +18,127 @@
 #include <llvm/Support/raw_ostream.h>
 
 namespace llvm {
-struct Hasher {
-  XXH3_state_t *state;
 
-  Hasher(Hasher &&other) {
-    state = other.state;
-    other.state = nullptr;
-  }
+/// Hash backends for BasicHasher.
+/// Each one holds its state inline and produces a digest of `Words` 64 bit words.
+struct XXH3_64Backend {
+  static constexpr const char *Name = "xxh3-64";
+  static constexpr unsigned Words = 1;
 
-  Hasher() {
-    state = XXH3_createState();
-    XXH3_128bits_reset(state);
-  }
+  XXH3_state_t state;
 
-  Hasher(const Hasher &) = delete;
-  Hasher &operator=(const Hasher &) = delete;
+  XXH3_64Backend() { XXH3_INITSTATE(&state); }
+  void reset() { XXH3_64bits_reset(&state); }
+  void update(const void *Data, size_t Len) { XXH3_64bits_update(&state, Data, Len); }
+  void final(uint64_t *Ret) const { Ret[0] = XXH3_64bits_digest(&state); }
+};
 
-  ~Hasher() {
-    if (state != nullptr) {
-      XXH3_freeState(state);
-      state = nullptr;
-    }
+struct XXH3_128Backend {
+  static constexpr const char *Name = "xxh3-128";
+  static constexpr unsigned Words = 2;
+
+  XXH3_state_t state;
+
+  XXH3_128Backend() { XXH3_INITSTATE(&state); }
+  void reset() { XXH3_128bits_reset(&state); }
+  void update(const void *Data, size_t Len) { XXH3_128bits_update(&state, Data, Len); }
+  void final(uint64_t *Ret) const {
+    XXH128_hash_t hash = XXH3_128bits_digest(&state);
+    Ret[0] = hash.high64;
+    Ret[1] = hash.low64;
   }
+};
+
+#ifdef HASH_BLAKE3
+struct Blake3Backend {
+  static constexpr const char *Name = "blake3";
+  static constexpr unsigned Words = 4;
+
+  blake3_hasher state;
+
+  void reset() { blake3_hasher_init(&state); }
+  void update(const void *Data, size_t Len) { blake3_hasher_update(&state, Data, Len); }
+  void final(uint64_t *Ret) const { blake3_hasher_finalize(&state, (uint8_t *)Ret, Words * sizeof(uint64_t)); }
+};
+#endif
+
+/// Incremental hasher for the IR.
+///
+/// Most updates are single 8 byte fields (opcodes, slot numbers, flags, type
+/// IDs). Instead of calling into the backend for each of them, they are
+/// appended to a fixed-size record buffer which is fed to the backend in large
+/// blocks. The streaming APIs don't depend on how the input is split, so the
+/// digest is the same as with per-field updates (`-DHASHER_UNBUFFERED`).
+template <typename Backend>
+struct BasicHasher {
+  /// Name of the hash algorithm, recorded in the cache directory.
+  static constexpr const char *Algorithm = Backend::Name;
+
+  Backend backend;
+
+#ifndef HASHER_UNBUFFERED
+  static constexpr size_t BufferSize = 4096;
+  size_t used = 0;
+  alignas(8) unsigned char buffer[BufferSize];
+#endif
+
+  BasicHasher() { backend.reset(); }
+
+  BasicHasher(const BasicHasher &) = delete;
+  BasicHasher &operator=(const BasicHasher &) = delete;
 
   struct Digest {
-    XXH128_hash_t hash;
+    uint64_t hash[Backend::Words];
+
+    bool operator==(const Digest &other) const { return std::equal(hash, hash + Backend::Words, other.hash); }
+    bool operator!=(const Digest &other) const { return !(*this == other); }
 
     SmallString<32> digest() const {
       std::stringstream retsstream;
-      retsstream << std::hex << std::setw(16) << std::setfill('0') << hash.high64 << std::setw(16) << std::setfill('0')
-                 << hash.low64;
+      retsstream << std::hex;
+      for (uint64_t word : hash) {
+        retsstream << std::setw(16) << std::setfill('0') << word;
+      }
       return SmallString<32>(retsstream.str());
     }
   };
 
+#ifdef HASHER_UNBUFFERED
+  void update(const void *Data, size_t Len) { backend.update(Data, Len); }
+
+  void flush() {}
+#else
+  void update(const void *Data, size_t Len) {
+    if (used + Len > BufferSize) {
+      flush();
+      if (Len > BufferSize) {
+        // Large inputs (strings, constant data) go to the backend directly
+        backend.update(Data, Len);
+        return;
+      }
+    }
+    memcpy(buffer + used, Data, Len);
+    used += Len;
+  }
+
+  /// Feed the buffered records to the backend.
+  void flush() {
+    if (used) {
+      backend.update(buffer, used);
+      used = 0;
+    }
+  }
+#endif
+
   /// Add the bytes in the StringRef \p Str to the hash.
   // Note that this isn't a string and so this won't include any trailing NULL
   // bytes.
-  void update(StringRef Str) { XXH3_128bits_update(state, Str.data(), Str.size()); }
+  void update(StringRef Str) { update(Str.data(), Str.size()); }
 
-  void update(uint64_t Data) { XXH3_128bits_update(state, (const void *)&Data, sizeof(Data)); }
+  void update(uint64_t Data) { update((const void *)&Data, sizeof(Data)); }
 
-  void update(void *Data, size_t Len) { XXH3_128bits_update(state, Data, Len); }
+  /// Add a digest of another Hasher, e.g. the digest of a single function.
+  void update(const Digest &D) { update((const void *)&D.hash, sizeof(D.hash)); }
 
   void update(const GlobalObject &GO) {
     std::string str;
@@ -61,13 +147,21 @@ struct Hasher {
     update(retsstream.str());
   }
 
-  void final(Digest &Ret) const {
-    Ret.hash = XXH3_128bits_digest(state);
-    // outs() << "final state: " << state << "\n";
+  /// Start over with an empty hash.
+  void reset() {
+#ifndef HASHER_UNBUFFERED
+    used = 0;
+#endif
+    backend.reset();
+  }
+
+  void final(Digest &Ret) {
+    flush();
+    backend.final(Ret.hash);
   }
 
   static Digest hash(const GlobalObject &GO) {
-    Hasher hash;
+    BasicHasher hash;
     hash.update(GO);
 
     Digest digest;
@@ -76,7 +170,7 @@ struct Hasher {
   }
 
   static Digest hash(StringRef str) {
-    Hasher hash;
+    BasicHasher hash;
     hash.update(str);
 
     Digest digest;
@@ -85,6 +179,31 @@ struct Hasher {
   }
 };
 
+/// Number of hex digits in the keys of the backend named \p algorithm, or 0
+/// for unknown ones. Covers the backends left out of this build as well, so
+/// irhashd can serve caches of any of them.
+inline unsigned key_digits(StringRef algorithm) {
+  if (algorithm == XXH3_64Backend::Name) {
+    return XXH3_64Backend::Words * 16;
+  }
+  if (algorithm == XXH3_128Backend::Name) {
+    return XXH3_128Backend::Words * 16;
+  }
+  if (algorithm == "blake3") {
+    return 4 * 16;
+  }
+  return 0;
+}
+
+// The backend is chosen at build time, see the Makefile
+#if defined(HASH_XXH3_64)
+using Hasher = BasicHasher<XXH3_64Backend>;
+#elif defined(HASH_BLAKE3)
+using Hasher = BasicHasher<Blake3Backend>;
+#else
+using Hasher = BasicHasher<XXH3_128Backend>;
+#endif
+
 } // namespace llvm
 
 #endif // IRHASH_HASH_HPP
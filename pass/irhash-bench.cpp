@@ -0,0 +1,93 @@
+// Benchmark for the IRHash hashing code.
+// Loads LLVM modules (.bc or .ll) and hashes each of them repeatedly, without
+// touching the cache. Reports the throughput in instructions and bitcode
+// bytes per second, and the hashing time relative to loading the module.
+// With -debuginfo, the metadata is hashed as well (IRHASH_DEBUGINFO), with
+// -canonical the names of local values aren't (IRHASH_CANONICAL), with
+// -unordered functions and globals are combined by name (IRHASH_UNORDERED),
+// and with -prune only the live ones are hashed (IRHASH_PRUNE).
+
+#include "pass.hpp"
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <chrono>
+
+using namespace llvm;
+
+static cl::list<std::string> InputFiles(cl::Positional, cl::OneOrMore, cl::desc("<input .bc/.ll files>"));
+static cl::opt<unsigned> Repetitions("n", cl::init(100), cl::desc("Hash every module <n> times"));
+static cl::opt<unsigned> Threads("j", cl::init(1), cl::desc("Number of hashing threads"));
+static cl::opt<bool> DebugInfo("debuginfo", cl::desc("Hash metadata and debug info, like IRHASH_DEBUGINFO"));
+static cl::opt<bool> Canonical("canonical", cl::desc("Ignore the names of local values, like IRHASH_CANONICAL"));
+static cl::opt<bool> Unordered("unordered", cl::desc("Ignore the order of functions and globals, like IRHASH_UNORDERED"));
+static cl::opt<bool> Prune("prune", cl::desc("Ignore unused declarations and dead internal symbols, like IRHASH_PRUNE"));
+
+#ifdef HASHER_UNBUFFERED
+static const char *Variant = "per-field";
+#else
+static const char *Variant = "buffered";
+#endif
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash hashing benchmark\n");
+  HashOptions Options;
+  Options.DebugInfo = DebugInfo;
+  Options.Canonical = Canonical;
+  Options.Unordered = Unordered;
+  Options.Prune = Prune;
+
+  outs() << "# hasher: " << Variant << ' ' << Hasher::Algorithm << ", threads: " << Threads << ", repetitions: " << Repetitions
+         << (DebugInfo ? ", debug info" : "") << (Canonical ? ", canonical" : "") << (Unordered ? ", unordered" : "")
+         << (Prune ? ", prune" : "") << '\n';
+  outs() << "# file key insts KiB mean[us] min[us] Minst/s MB/s hash/load\n";
+
+  double total = 0;
+  uint64_t totalInsts = 0, totalBytes = 0;
+  for (const std::string &File : InputFiles) {
+    LLVMContext Context;
+    SMDiagnostic Err;
+    auto loadStart = std::chrono::steady_clock::now();
+    std::unique_ptr<Module> M = parseIRFile(File, Err, Context);
+    std::chrono::duration<double, std::micro> load = std::chrono::steady_clock::now() - loadStart;
+    if (!M) {
+      Err.print(argv[0], errs());
+      return 1;
+    }
+
+    // The size of the IR is measured as bitcode, whatever the input format
+    SmallVector<char, 0> Bitcode;
+    raw_svector_ostream BitcodeStream(Bitcode);
+    WriteBitcodeToFile(*M, BitcodeStream);
+    const uint64_t insts = M->getInstructionCount(), bytes = Bitcode.size();
+
+    // warm up and get the key
+    Hasher::Digest digest = IRHashPass::hashModule(*M, Threads, Options);
+
+    double sum = 0, min = std::numeric_limits<double>::max();
+    for (unsigned i = 0; i < Repetitions; i++) {
+      auto start = std::chrono::steady_clock::now();
+      IRHashPass::hashModule(*M, Threads, Options);
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      sum += elapsed.count();
+      min = std::min(min, elapsed.count());
+    }
+    total += sum;
+    totalInsts += insts * Repetitions;
+    totalBytes += bytes * Repetitions;
+
+    const double mean = sum / Repetitions;
+    outs() << File << ' ' << digest.digest() << ' ' << insts << ' ' << format("%.1f", bytes / 1024.0) << ' '
+           << format("%.1f", mean) << ' ' << format("%.1f", min) << ' ' << format("%.2f", insts / mean) << ' '
+           << format("%.2f", bytes / mean) << ' ' << format("%.3f", mean / load.count()) << '\n';
+  }
+  outs() << "# total[ms] " << format("%.3f", total / 1000) << " Minst/s " << format("%.2f", totalInsts / total)
+         << " MB/s " << format("%.2f", totalBytes / total) << '\n';
+  return 0;
+}
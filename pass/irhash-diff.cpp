@@ -0,0 +1,644 @@
+// Differential test of the IRHash key against hashing the printed IR.
+// Loads LLVM modules (.bc or .ll) and compares the structural key of
+// IRHashPass::hashModule with a key of the textual IR, which
+// Hasher::hash(const GlobalObject &) computes for every function and global:
+//
+// - Mutants of every module (flipped flags, swapped operands, changed
+//   constants and attributes) have different IR. If one still has the key of
+//   the module, a compilation would restore the wrong object file (false
+//   sharing).
+// - Copies of every module (cloned, or read back from bitcode or text, hashed
+//   on more threads) have the same IR. If one gets another key, the cache
+//   misses for nothing (spurious miss). With -canonical, so does a copy whose
+//   local values are named differently, with -unordered one whose functions
+//   and globals are in another order, and with -prune one with unused
+//   declarations and dead internal symbols. -prune leaves the symbols which
+//   GlobalDCE removes out of the printed IR as well, so the key is checked
+//   against liveness that IRHashPass::collectLive() does not compute.
+//
+// Also reports how much faster the structural key is. Exits with 1 if there
+// is any false sharing or spurious miss, so hashing changes can be checked
+// with `make diff`.
+
+#include "pass.hpp"
+
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Transforms/IPO/GlobalDCE.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <random>
+
+using namespace llvm;
+
+static cl::list<std::string> InputFiles(cl::Positional, cl::OneOrMore, cl::desc("<input .bc/.ll files>"));
+static cl::opt<unsigned> Mutants("n", cl::init(50), cl::desc("Mutants of every module per kind of mutation"));
+static cl::opt<unsigned> Seed("seed", cl::init(1), cl::desc("Seed of the mutations"));
+static cl::opt<unsigned> Repetitions("r", cl::init(20), cl::desc("Hash every module <r> times to compare the speed"));
+static cl::opt<bool> DebugInfo("debuginfo", cl::desc("Hash metadata and debug info, like IRHASH_DEBUGINFO"));
+static cl::opt<bool> Canonical("canonical", cl::desc("Ignore the names of local values, like IRHASH_CANONICAL"));
+static cl::opt<bool> Unordered("unordered", cl::desc("Ignore the order of functions and globals, like IRHASH_UNORDERED"));
+static cl::opt<bool> Prune("prune", cl::desc("Ignore unused declarations and dead internal symbols, like IRHASH_PRUNE"));
+static cl::opt<bool> Verbose("v", cl::desc("Print every false sharing and spurious miss"));
+
+static HashOptions Options;
+
+/// Adds the symbols of \p M which GlobalDCE keeps to \p Live. Unused
+/// linkonce definitions are emitted without optimization, so they become weak
+/// in the copy which GlobalDCE runs on.
+static void collect_live(const Module &M, SmallPtrSetImpl<const GlobalValue *> &Live) {
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> C = CloneModule(M, VMap);
+  for (GlobalValue &GV : C->global_values()) {
+    if (GV.hasLinkOnceLinkage()) {
+      GV.setLinkage(GV.hasLinkOnceODRLinkage() ? GlobalValue::WeakODRLinkage : GlobalValue::WeakAnyLinkage);
+    }
+  }
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  GlobalDCEPass().run(*C, MAM);
+
+  // The mapped values of the removed symbols are null
+  for (const GlobalValue &GV : M.global_values()) {
+    if (VMap.lookup(&GV)) {
+      Live.insert(&GV);
+    }
+  }
+}
+
+/// Key of the printed IR of \p M: the digest of the text of every function
+/// and global (only the ones in \p Live with -prune), and the rest of the
+/// module as text. Modules with the same key are the same IR.
+static Hasher::Digest printed_key(const Module &M, const SmallPtrSetImpl<const GlobalValue *> &Live) {
+  auto printed = [&](const GlobalValue &GV) { return !Prune || Live.count(&GV); };
+
+  Hasher hash;
+  hash.update(M.getTargetTriple());
+  hash.update(M.getDataLayoutStr());
+  hash.update(M.getModuleInlineAsm());
+
+  std::string str;
+  raw_string_ostream os(str);
+  for (const StructType *T : M.getIdentifiedStructTypes()) {
+    os << *T << '\n';
+  }
+  for (const GlobalAlias &GA : M.aliases()) {
+    os << GA << '\n';
+  }
+  for (const GlobalIFunc &GI : M.ifuncs()) {
+    os << GI << '\n';
+  }
+  hash.update(os.str());
+
+  for (const GlobalVariable &GV : M.globals()) {
+    if (printed(GV)) {
+      hash.update(Hasher::hash(GV));
+    }
+  }
+  for (const Function &F : M) {
+    if (printed(F)) {
+      hash.update(Hasher::hash(F));
+    }
+  }
+  Hasher::Digest digest;
+  hash.final(digest);
+  return digest;
+}
+
+static Hasher::Digest printed_key(const Module &M) {
+  SmallPtrSet<const GlobalValue *, 32> Live;
+  if (Prune) {
+    collect_live(M, Live);
+  }
+  return printed_key(M, Live);
+}
+
+template <typename T> static std::string to_string(const T &value) {
+  std::string str;
+  raw_string_ostream os(str);
+  os << value;
+  return os.str();
+}
+
+template <typename T> static T *pick(const std::vector<T *> &candidates, std::mt19937 &rng) {
+  if (candidates.empty()) {
+    return nullptr;
+  }
+  return candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+}
+
+/// The instructions of \p M for which \p pred holds.
+template <typename Pred> static std::vector<Instruction *> instructions(Module &M, Pred pred) {
+  std::vector<Instruction *> result;
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        if (pred(I)) {
+          result.push_back(&I);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+/// A different constant of the type of \p C, with one integer or floating
+/// point number in it changed. Null if \p C has no number.
+static Constant *mutate_constant(Constant *C, std::mt19937 &rng) {
+  if (const ConstantInt *CI = dyn_cast<ConstantInt>(C)) {
+    return ConstantInt::get(CI->getType(), CI->getValue() + 1);
+  }
+  if (const ConstantFP *CFP = dyn_cast<ConstantFP>(C)) {
+    APFloat value = CFP->getValueAPF();
+    value.add(APFloat(value.getSemantics(), 1), APFloat::rmNearestTiesToEven);
+    return ConstantFP::get(C->getContext(), value);
+  }
+  if (isa<GlobalValue>(C) || isa<BlockAddress>(C)) {
+    return nullptr;
+  }
+
+  // Change one of the elements or operands, tried in random order
+  std::vector<Constant *> ops;
+  if (const ConstantDataSequential *CDS = dyn_cast<ConstantDataSequential>(C)) {
+    for (unsigned i = 0; i < CDS->getNumElements(); i++) {
+      ops.push_back(CDS->getElementAsConstant(i));
+    }
+  } else {
+    for (Value *op : C->operands()) {
+      ops.push_back(cast<Constant>(op));
+    }
+  }
+  std::vector<unsigned> order(ops.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng);
+  if (isa<GEPOperator>(C)) {
+    // Only the first index, the others may index into structs
+    order.assign(ops.size() > 1 ? 1 : 0, 1);
+  }
+  for (unsigned i : order) {
+    Constant *changed = mutate_constant(ops[i], rng);
+    if (!changed) {
+      continue;
+    }
+    ops[i] = changed;
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(C)) {
+      return CE->getWithOperands(ops);
+    }
+    if (ArrayType *ATy = dyn_cast<ArrayType>(C->getType())) {
+      return ConstantArray::get(ATy, ops);
+    }
+    if (StructType *STy = dyn_cast<StructType>(C->getType())) {
+      return ConstantStruct::get(STy, ops);
+    }
+    return ConstantVector::get(ops);
+  }
+  return nullptr;
+}
+
+/// Flip the flag \p get / \p set of a random instruction of type \p T.
+template <typename T, typename Get, typename Set>
+static Instruction *flip(Module &M, std::mt19937 &rng, Get get, Set set) {
+  Instruction *I = pick(instructions(M, [](Instruction &I) { return isa<T>(I); }), rng);
+  if (I) {
+    set(cast<T>(I), !get(cast<T>(I)));
+  }
+  return I;
+}
+
+/// A kind of mutation. It changes a random site of a module and returns it,
+/// null if the module has none.
+struct Mutation {
+  const char *name;
+  Value *(*mutate)(Module &M, std::mt19937 &rng);
+};
+
+static const Mutation mutations[] = {
+    {"nsw",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       return flip<OverflowingBinaryOperator>(
+           M, rng, [](auto *I) { return I->hasNoSignedWrap(); },
+           [](auto *I, bool v) { cast<BinaryOperator>(I)->setHasNoSignedWrap(v); });
+     }},
+    {"nuw",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       return flip<OverflowingBinaryOperator>(
+           M, rng, [](auto *I) { return I->hasNoUnsignedWrap(); },
+           [](auto *I, bool v) { cast<BinaryOperator>(I)->setHasNoUnsignedWrap(v); });
+     }},
+    {"exact",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       return flip<PossiblyExactOperator>(
+           M, rng, [](auto *I) { return I->isExact(); },
+           [](auto *I, bool v) { cast<BinaryOperator>(I)->setIsExact(v); });
+     }},
+    {"fast-math",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       Instruction *I = pick(instructions(M, [](Instruction &I) { return isa<FPMathOperator>(I); }), rng);
+       if (I) {
+         FastMathFlags FMF;
+         FMF.setFast(!I->getFastMathFlags().any());
+         I->copyFastMathFlags(FMF);
+       }
+       return I;
+     }},
+    {"inbounds",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       return flip<GetElementPtrInst>(
+           M, rng, [](auto *I) { return I->isInBounds(); }, [](auto *I, bool v) { I->setIsInBounds(v); });
+     }},
+    {"volatile",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       Instruction *I = pick(instructions(M, [](Instruction &I) { return isa<LoadInst>(I) || isa<StoreInst>(I); }), rng);
+       if (LoadInst *LI = dyn_cast_or_null<LoadInst>(I)) {
+         LI->setVolatile(!LI->isVolatile());
+       } else if (StoreInst *SI = dyn_cast_or_null<StoreInst>(I)) {
+         SI->setVolatile(!SI->isVolatile());
+       }
+       return I;
+     }},
+    {"align",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       Instruction *I = pick(instructions(M, [](Instruction &I) { return isa<LoadInst>(I) || isa<StoreInst>(I); }), rng);
+       if (LoadInst *LI = dyn_cast_or_null<LoadInst>(I)) {
+         LI->setAlignment(Align(LI->getAlign().value() * 2));
+       } else if (StoreInst *SI = dyn_cast_or_null<StoreInst>(I)) {
+         SI->setAlignment(Align(SI->getAlign().value() * 2));
+       }
+       return I;
+     }},
+    {"predicate",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       CmpInst *I = cast_or_null<CmpInst>(pick(instructions(M, [](Instruction &I) { return isa<CmpInst>(I); }), rng));
+       if (I) {
+         I->setPredicate(I->getInversePredicate());
+       }
+       return I;
+     }},
+    {"swap-operands",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       Instruction *I = pick(instructions(M,
+                                          [](Instruction &I) {
+                                            return (isa<BinaryOperator>(I) || isa<CmpInst>(I)) &&
+                                                   I.getOperand(0) != I.getOperand(1);
+                                          }),
+                             rng);
+       if (I) {
+         Value *op = I->getOperand(0);
+         I->setOperand(0, I->getOperand(1));
+         I->setOperand(1, op);
+       }
+       return I;
+     }},
+    {"constant",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       // Only operands which are values, not the indices into structs, case
+       // values or the immediate arguments of intrinsics
+       auto mutable_operand = [](Instruction &I, unsigned i) {
+         const Value *op = I.getOperand(i);
+         if (!isa<Constant>(op) || isa<GlobalValue>(op) || (isa<GetElementPtrInst>(I) && i != 1) ||
+             isa<ShuffleVectorInst>(I) || isa<SwitchInst>(I)) {
+           return false;
+         }
+         const CallBase *CB = dyn_cast<CallBase>(&I);
+         return !CB || (CB->isArgOperand(&I.getOperandUse(i)) && !isa<IntrinsicInst>(CB));
+       };
+       std::vector<Instruction *> candidates = instructions(M, [&](Instruction &I) {
+         for (unsigned i = 0; i < I.getNumOperands(); i++) {
+           if (mutable_operand(I, i)) {
+             return true;
+           }
+         }
+         return false;
+       });
+       std::shuffle(candidates.begin(), candidates.end(), rng);
+       for (Instruction *I : candidates) {
+         for (unsigned i = 0; i < I->getNumOperands(); i++) {
+           if (!mutable_operand(*I, i)) {
+             continue;
+           }
+           if (Constant *C = mutate_constant(cast<Constant>(I->getOperand(i)), rng)) {
+             I->setOperand(i, C);
+             return I;
+           }
+         }
+       }
+       return nullptr;
+     }},
+    {"initializer",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       std::vector<GlobalVariable *> candidates;
+       for (GlobalVariable &GV : M.globals()) {
+         if (GV.hasInitializer()) {
+           candidates.push_back(&GV);
+         }
+       }
+       std::shuffle(candidates.begin(), candidates.end(), rng);
+       for (GlobalVariable *GV : candidates) {
+         if (Constant *C = mutate_constant(GV->getInitializer(), rng)) {
+           GV->setInitializer(C);
+           return GV;
+         }
+       }
+       return nullptr;
+     }},
+    {"attribute",
+     [](Module &M, std::mt19937 &rng) -> Value * {
+       // Attributes of functions and calls: a string attribute gets another
+       // value, an integer attribute twice its value
+       struct Site {
+         Value *V;
+         unsigned index;
+         Attribute A;
+       };
+       std::vector<Site> candidates;
+       auto add = [&](Value *V, const AttributeList &AL) {
+         for (unsigned index : AL.indexes()) {
+           for (const Attribute &A : AL.getAttributes(index)) {
+             if (A.isStringAttribute() || A.isIntAttribute()) {
+               candidates.push_back({V, index, A});
+             }
+           }
+         }
+       };
+       for (Function &F : M) {
+         add(&F, F.getAttributes());
+       }
+       for (Instruction *I : instructions(M, [](Instruction &I) { return isa<CallBase>(I); })) {
+         add(I, cast<CallBase>(I)->getAttributes());
+       }
+       if (candidates.empty()) {
+         return nullptr;
+       }
+       const Site &site = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+       LLVMContext &Context = M.getContext();
+       const Attribute changed =
+           site.A.isStringAttribute()
+               ? Attribute::get(Context, site.A.getKindAsString(), site.A.getValueAsString().str() + "1")
+               : Attribute::get(Context, site.A.getKindAsEnum(), site.A.getValueAsInt() * 2);
+       if (Function *F = dyn_cast<Function>(site.V)) {
+         F->setAttributes(F->getAttributes().addAttributeAtIndex(Context, site.index, changed));
+       } else {
+         CallBase *CB = cast<CallBase>(site.V);
+         CB->setAttributes(CB->getAttributes().addAttributeAtIndex(Context, site.index, changed));
+       }
+       return site.V;
+     }},
+};
+
+/// Copies of a module which are the same IR.
+struct Copy {
+  const char *name;
+  std::function<Hasher::Digest(const Module &M, Hasher::Digest &printed)> key;
+  const cl::opt<bool> *mode = nullptr; // only the same IR with this option, e.g. -canonical
+};
+
+/// Name every unnamed block, argument and instruction of \p M and drop the
+/// names of the others, like building with and without
+/// -fno-discard-value-names.
+static void rename_locals(Module &M) {
+  auto rename = [](Value &V) { V.setName(V.hasName() ? "" : "v"); };
+  for (Function &F : M) {
+    for (Argument &Arg : F.args()) {
+      rename(Arg);
+    }
+    for (BasicBlock &BB : F) {
+      rename(BB);
+      for (Instruction &I : BB) {
+        if (!I.getType()->isVoidTy()) {
+          rename(I);
+        }
+      }
+    }
+  }
+}
+
+/// Reverse the order of the named functions and globals of \p M, like moving
+/// definitions around in the source. Unnamed ones keep their order.
+static void reorder(Module &M) {
+  std::vector<Function *> Functions;
+  for (Function &F : M) {
+    if (F.hasName()) {
+      Functions.push_back(&F);
+    }
+  }
+  for (Function *F : Functions) {
+    F->removeFromParent();
+    M.getFunctionList().push_front(F);
+  }
+
+  std::vector<GlobalVariable *> Globals;
+  for (GlobalVariable &GV : M.globals()) {
+    if (GV.hasName()) {
+      Globals.push_back(&GV);
+    }
+  }
+  for (GlobalVariable *GV : Globals) {
+#if LLVM_VERSION_MAJOR >= 17
+    M.removeGlobalVariable(GV);
+    M.insertGlobalVariable(M.global_begin(), GV);
+#else
+    GV->removeFromParent();
+    M.getGlobalList().push_front(GV);
+#endif
+  }
+}
+
+/// Add an unused declaration, and a dead internal function and global to
+/// \p M, like a header with another prototype and static inline function.
+static void add_dead_symbols(Module &M) {
+  LLVMContext &Context = M.getContext();
+  Type *Int32 = Type::getInt32Ty(Context);
+  FunctionType *FTy = FunctionType::get(Type::getVoidTy(Context), {Int32}, false);
+  Function::Create(FTy, GlobalValue::ExternalLinkage, "irhash_diff_unused", M);
+
+  // The dead function calls a declaration nothing live calls
+  Function *Callee = Function::Create(FTy, GlobalValue::ExternalLinkage, "irhash_diff_dead_callee", M);
+  Function *Dead = Function::Create(FTy, GlobalValue::InternalLinkage, "irhash_diff_dead", M);
+  IRBuilder<> Builder(BasicBlock::Create(Context, "entry", Dead));
+  Builder.CreateCall(Callee, {Dead->getArg(0)});
+  Builder.CreateRetVoid();
+
+  new GlobalVariable(M, Int32, false, GlobalValue::InternalLinkage, ConstantInt::get(Int32, 1), "irhash_diff_dead_global");
+}
+
+static const Copy copies[] = {
+    {"clone",
+     [](const Module &M, Hasher::Digest &printed) {
+       std::unique_ptr<Module> C = CloneModule(M);
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     }},
+    {"bitcode",
+     [](const Module &M, Hasher::Digest &printed) {
+       SmallVector<char, 0> Bitcode;
+       raw_svector_ostream os(Bitcode);
+       WriteBitcodeToFile(M, os);
+       LLVMContext Context;
+       std::unique_ptr<Module> C =
+           cantFail(parseBitcodeFile(MemoryBufferRef(StringRef(Bitcode.data(), Bitcode.size()), "bitcode"), Context));
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     }},
+    {"text",
+     [](const Module &M, Hasher::Digest &printed) {
+       LLVMContext Context;
+       SMDiagnostic Err;
+       std::unique_ptr<Module> C = parseAssemblyString(to_string(M), Err, Context);
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     }},
+    {"threads",
+     [](const Module &M, Hasher::Digest &printed) {
+       printed = printed_key(M);
+       return IRHashPass::hashModule(M, 4, Options);
+     }},
+    {"local-names",
+     [](const Module &M, Hasher::Digest &printed) {
+       std::unique_ptr<Module> C = CloneModule(M);
+       rename_locals(*C);
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     },
+     &Canonical},
+    {"reorder",
+     [](const Module &M, Hasher::Digest &printed) {
+       std::unique_ptr<Module> C = CloneModule(M);
+       reorder(*C);
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     },
+     &Unordered},
+    {"dead-symbols",
+     [](const Module &M, Hasher::Digest &printed) {
+       std::unique_ptr<Module> C = CloneModule(M);
+       add_dead_symbols(*C);
+       printed = printed_key(*C);
+       return IRHashPass::hashModule(*C, 1, Options);
+     },
+     &Prune},
+};
+
+/// Microseconds per call of \p f.
+template <typename F> static double time_us(F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < Repetitions; i++) {
+    f();
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / std::max(1u, (unsigned)Repetitions);
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash differential test against printed IR\n");
+  Options.DebugInfo = DebugInfo;
+  Options.Canonical = Canonical;
+  Options.Unordered = Unordered;
+  Options.Prune = Prune;
+  std::mt19937 rng(Seed);
+
+  outs() << "# hasher: " << Hasher::Algorithm << ", mutants: " << Mutants << ", seed: " << Seed
+         << (DebugInfo ? ", debug info" : "") << (Canonical ? ", canonical" : "") << (Unordered ? ", unordered" : "")
+         << (Prune ? ", prune" : "") << '\n';
+  outs() << "# file check tried changed wrong\n";
+
+  unsigned totalWrong = 0;
+  unsigned sameKeys[std::size(copies)] = {};
+  double totalStructural = 0, totalPrinted = 0;
+  for (const std::string &File : InputFiles) {
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(File, Err, Context);
+    if (!M) {
+      Err.print(argv[0], errs());
+      return 1;
+    }
+    const Hasher::Digest key = IRHashPass::hashModule(*M, 1, Options);
+    const Hasher::Digest printed = printed_key(*M);
+
+    // Different IR must have a different key
+    for (const Mutation &mutation : mutations) {
+      unsigned tried = 0, changed = 0, wrong = 0;
+      for (unsigned i = 0; i < Mutants; i++) {
+        std::unique_ptr<Module> Mutant = CloneModule(*M);
+        Value *site = mutation.mutate(*Mutant, rng);
+        if (!site) {
+          break;
+        }
+        tried++;
+        if (printed_key(*Mutant) == printed) {
+          continue;
+        }
+        changed++;
+        if (IRHashPass::hashModule(*Mutant, 1, Options) == key) {
+          wrong++;
+          if (Verbose) {
+            errs() << File << ": " << mutation.name << " keeps the key: " << *site << '\n';
+          }
+        }
+      }
+      outs() << File << ' ' << mutation.name << ' ' << tried << ' ' << changed << ' ' << wrong << '\n';
+      totalWrong += wrong;
+    }
+
+    // The same IR must have the same key
+    for (size_t i = 0; i < std::size(copies); i++) {
+      const Copy &copy = copies[i];
+      Hasher::Digest copyPrinted;
+      const bool same = copy.key(*M, copyPrinted) == key;
+      const bool wrong = (copyPrinted == printed || (copy.mode && *copy.mode)) && !same;
+      sameKeys[i] += same;
+      outs() << File << ' ' << copy.name << " 1 " << (copyPrinted != printed) << ' ' << wrong << '\n';
+      if (wrong && Verbose) {
+        errs() << File << ": " << copy.name << " changes the key\n";
+      }
+      totalWrong += wrong;
+    }
+
+    const double structural = time_us([&] { IRHashPass::hashModule(*M, 1, Options); });
+    // GlobalDCE is not part of the printed key
+    SmallPtrSet<const GlobalValue *, 32> Live;
+    if (Prune) {
+      collect_live(*M, Live);
+    }
+    const double text = time_us([&] { printed_key(*M, Live); });
+    totalStructural += structural;
+    totalPrinted += text;
+    outs() << File << " # structural[us] " << format("%.1f", structural) << " printed[us] " << format("%.1f", text)
+           << " speedup " << format("%.2f", text / structural) << '\n';
+  }
+  for (size_t i = 0; i < std::size(copies); i++) {
+    if (copies[i].mode) {
+      outs() << "# same key after " << copies[i].name << ": " << sameKeys[i] << " of " << InputFiles.size()
+             << " modules\n";
+    }
+  }
+  outs() << "# wrong keys " << totalWrong << " speedup " << format("%.2f", totalPrinted / totalStructural) << '\n';
+  return totalWrong ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+// Maintenance of the key index (`INDEX`) of an IRHash cache directory.
+//
+//   irhash-index rebuild   regenerate it from the shard directories, e.g.
+//                          if it is corrupt or the cache predates it
+//   irhash-index show      print its size and fill level
+
+#include "objectcache.hpp"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+
+using namespace llvm;
+
+static cl::opt<std::string> Command(cl::Positional, cl::Required, cl::desc("<rebuild|show>"));
+static cl::opt<std::string> CacheDir("cache", cl::desc("Cache directory (default: $IRHASH_CACHE)"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash key index maintenance\n");
+
+  if (CacheDir.empty()) {
+    if (const char *cachedir = getenv("IRHASH_CACHE")) {
+      CacheDir = cachedir;
+    } else {
+      errs() << "irhash-index: no cache directory, set IRHASH_CACHE or -cache\n";
+      return 1;
+    }
+  }
+  ObjectCache cache(CacheDir);
+
+  if (Command == "rebuild") {
+    if (!cache.rebuild_index()) {
+      perror("irhash-index: rebuild failed");
+      return 1;
+    }
+  } else if (Command != "show") {
+    errs() << "irhash-index: unknown command " << Command << '\n';
+    return 1;
+  }
+
+  KeyIndex *index = cache.index();
+  if (!index) {
+    errs() << "irhash-index: " << CacheDir << "/INDEX is missing or corrupt, run irhash-index rebuild\n";
+    return 1;
+  }
+  const uint64_t capacity = index->header->capacity, used = index->header->used, keys = index->count();
+  outs() << "slots: " << capacity << '\n';
+  outs() << "keys: " << keys << '\n';
+  outs() << "removed: " << used - keys << '\n';
+  outs() << "fill: " << format("%.1f%%", 100.0 * used / capacity) << '\n';
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Statistics of an IRHash cache directory.
+// Prints the counters kept in `STATS` by the compilations, the estimated
+// compile time the cache saved, and the size of the cache. Zero the counters
+// before a build (-z) to get the numbers of that build.
+
+#include "objectcache.hpp"
+#include "stats.hpp"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+
+using namespace llvm;
+
+static cl::opt<std::string> CacheDir("cache", cl::desc("Cache directory (default: $IRHASH_CACHE)"));
+static cl::opt<bool> Zero("z", cl::desc("Zero the counters"));
+static cl::opt<bool> JSON("json", cl::desc("Print as JSON"));
+
+static double seconds(uint64_t ns) { return ns / 1e9; }
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash cache statistics\n");
+
+  if (CacheDir.empty()) {
+    if (const char *cachedir = getenv("IRHASH_CACHE")) {
+      CacheDir = cachedir;
+    } else {
+      errs() << "irhash-stats: no cache directory, set IRHASH_CACHE or -cache\n";
+      return 1;
+    }
+  }
+
+  CacheStats stats;
+  if (!stats.open(CacheDir)) {
+    errs() << "irhash-stats: can't open " << CacheDir << "/STATS\n";
+    return 1;
+  }
+  if (Zero) {
+    stats.zero();
+    return 0;
+  }
+
+  const uint64_t hits = stats.get(CacheStats::Hits), misses = stats.get(CacheStats::Misses);
+  const uint64_t lookups = hits + misses;
+  // A hit saves what the rest of an average miss costs. Hashing every
+  // module, restoring hits and storing misses is the price for that.
+  const double saved = misses ? seconds(stats.get(CacheStats::MissNanos)) / misses * hits : 0;
+  const double overhead = seconds(stats.get(CacheStats::HashNanos) + stats.get(CacheStats::HitNanos) +
+                                  stats.get(CacheStats::StoreNanos));
+  const ObjectCache::Usage usage = ObjectCache(CacheDir).total_usage();
+
+  if (JSON) {
+    json::Object counters;
+    for (unsigned i = 0; i < CacheStats::NumCounters; i++) {
+      counters[CacheStats::Names[i]] = (int64_t)stats.get((CacheStats::Counter)i);
+    }
+    json::Object root{
+        {"counters", std::move(counters)},
+        {"hit_rate", lookups ? (double)hits / lookups : 0.0},
+        {"saved_seconds", saved},
+        {"overhead_seconds", overhead},
+        {"cache", json::Object{{"entries", (int64_t)usage.entries},
+                               {"bytes", (int64_t)usage.bytes},
+                               {"raw_bytes", (int64_t)usage.raw_bytes}}},
+    };
+    outs() << formatv("{0:2}", json::Value(std::move(root))) << '\n';
+    return 0;
+  }
+
+  outs() << "hits: " << hits << '\n';
+  outs() << "misses: " << misses << '\n';
+  outs() << "direct hits: " << stats.get(CacheStats::DirectHits) << '\n';
+  outs() << "hits after optimization: " << stats.get(CacheStats::OptimizedHits) << '\n';
+  outs() << "hit rate: " << format("%.1f%%", lookups ? 100.0 * hits / lookups : 0.0) << '\n';
+  outs() << "stores: " << stats.get(CacheStats::Stores) << " (" << stats.get(CacheStats::StoreFailures)
+         << " failed)\n";
+  outs() << "restore failures: " << stats.get(CacheStats::RestoreFailures) << '\n';
+  outs() << "bytes restored: " << stats.get(CacheStats::BytesRestored) << '\n';
+  outs() << "bytes stored: " << stats.get(CacheStats::BytesStored) << '\n';
+  outs() << "hashing time: " << format("%.3f s", seconds(stats.get(CacheStats::HashNanos)));
+  if (lookups) {
+    outs() << format(" (%.3f ms per module)", 1e3 * seconds(stats.get(CacheStats::HashNanos)) / lookups);
+  }
+  outs() << '\n';
+  outs() << "time saved (estimate): " << format("%.1f s", saved) << '\n';
+  outs() << "overhead: " << format("%.1f s", overhead) << '\n';
+  outs() << "cache: " << usage.entries << " entries, " << usage.bytes << " bytes";
+  if (usage.raw_bytes > usage.bytes) {
+    outs() << format(" (%.2fx compressed)", (double)usage.raw_bytes / usage.bytes);
+  }
+  outs() << '\n';
+  return 0;
+}
@@ -0,0 +1,289 @@
+// irhash-tool: compute IRHash keys outside of a compilation.
+// Hashes LLVM modules (.bc or .ll files, or all .bc files below the given
+// directories) on all cores and prints `<key> <file>` for each of them.
+//
+// With -populate, the object file of every module is stored in the cache under
+// the module's key, so a cache can be seeded from the bitcode and objects
+// another build exported. The object file of `dir/sub/foo.bc` is
+// `dir/sub/foo.o`, or `<objects>/sub/foo.o` with -objects.
+//
+// The keys match those of the pass if the bitcode is the module the pass sees,
+// for pass-skip.so that is the output of `clang -c -emit-llvm -Xclang
+// -disable-llvm-passes` with the flags of the build. The objects of LTO
+// builds have other keys than the module, -kind gives their kind. Kinds
+// with further files, e.g. `+dwo`, are stored as bundles like the pass does,
+// with the files the driver writes next to the object file. The keys
+// also cover the configuration of the compiler, e.g. its target CPU and
+// optimization level, which -config gives as pass-debug.so logs it. Without
+// it, the keys are those of a compiler with the LLVM version of irhash-tool
+// and no other options, so -populate requires it. Like the pass, metadata
+// is only hashed with IRHASH_DEBUGINFO, local names are ignored with
+// IRHASH_CANONICAL, the order of functions and globals with
+// IRHASH_UNORDERED, and dead symbols with IRHASH_PRUNE.
+
+#include "daemon.hpp"
+#include "objectcache.hpp"
+#include "pass.hpp"
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace llvm;
+
+static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore, cl::desc("<.bc/.ll files or directories>"));
+static cl::opt<unsigned> Threads("j", cl::init(0), cl::desc("Number of threads (default: all cores)"));
+static cl::opt<bool> Populate("populate", cl::desc("Store the object file of every module in the cache"));
+static cl::opt<std::string> Objects("objects", cl::desc("Directory of the object files (default: next to the modules)"));
+static cl::opt<std::string> CacheDir("cache", cl::desc("Cache directory (default: $IRHASH_CACHE)"));
+static cl::opt<std::string> Kind("kind", cl::desc("Kind of the object files as pass-debug.so logs it, e.g. "
+                                                  "thin-lto (default: native object files)"));
+static cl::opt<std::string> Config("config", cl::desc("Configuration of the compiler as pass-debug.so logs it, e.g. "
+                                                     "llvm=18.1.8,-march=native,host-cpu=znver3,opt=O2 (required "
+                                                     "with -populate, default: the LLVM version of irhash-tool)"));
+
+/// A module to hash, and the path of its object file relative to -objects.
+struct Input {
+  std::string file;
+  std::string relative;
+};
+
+struct Result {
+  std::string key;
+  enum { Failed, Hashed, Stored, Cached, NoObject, StoreFailed } status = Failed;
+};
+
+/// Role of a further file in the entries of -kind, see OutputOptions in
+/// pass.cpp, with the extensions the driver gives it next to the object file.
+using ExtraRole = std::pair<StringRef, std::vector<StringRef>>;
+
+static const ExtraRole ExtraRoles[] = {
+    {"dwo", {".dwo"}},
+    {"time-trace", {".json"}},
+    {"opt-record", {".opt.yaml", ".opt.bitstream"}},
+    {"stack-usage", {".su"}},
+};
+
+/// The roles of the "+<role>" parts of -kind, with their extensions. Fails
+/// for roles the pass doesn't bundle.
+static bool extra_roles(std::vector<const ExtraRole *> &roles) {
+  SmallVector<StringRef, 4> parts;
+  StringRef(Kind).split(parts, ',');
+  for (StringRef part : parts) {
+    if (!part.consume_front("+")) {
+      continue;
+    }
+    auto role = std::find_if(std::begin(ExtraRoles), std::end(ExtraRoles),
+                             [&](const auto &known) { return known.first == part; });
+    if (role == std::end(ExtraRoles)) {
+      errs() << "irhash-tool: unknown further file +" << part << " in -kind\n";
+      return false;
+    }
+    roles.push_back(role);
+  }
+  return true;
+}
+
+static std::vector<const ExtraRole *> Extras; // of -kind
+
+static std::string object_of(const Input &input) {
+  SmallString<256> path(Objects.empty() ? StringRef(input.file) : StringRef(Objects));
+  if (!Objects.empty()) {
+    sys::path::append(path, input.relative);
+  }
+  sys::path::replace_extension(path, ".o");
+  return std::string(path);
+}
+
+static void collect(const std::string &arg, std::vector<Input> &inputs) {
+  if (!sys::fs::is_directory(arg)) {
+    inputs.push_back({arg, std::string(sys::path::filename(arg))});
+    return;
+  }
+
+  std::error_code ec;
+  for (sys::fs::recursive_directory_iterator it(arg, ec), end; it != end && !ec; it.increment(ec)) {
+    StringRef path(it->path());
+    if (it->type() == sys::fs::file_type::regular_file && sys::path::extension(path) == ".bc") {
+      StringRef relative(path.drop_front(arg.size()));
+      inputs.push_back({path.str(), relative.ltrim('/').str()});
+    }
+  }
+  if (ec) {
+    errs() << "irhash-tool: " << arg << ": " << ec.message() << '\n';
+  }
+}
+
+/// Hash (and store) the modules which \p next hands out.
+static void worker(const std::vector<Input> &inputs, std::vector<Result> &results, std::atomic<size_t> &next) {
+  // Every thread has its own view of the cache, ObjectCache maps the index lazily
+  std::unique_ptr<ObjectCache> cache;
+  DaemonClient irhashd;
+  if (Populate) {
+    cache = std::make_unique<ObjectCache>(CacheDir);
+    if (const char *socket = getenv("IRHASH_DAEMON")) {
+      irhashd.connect(socket);
+    }
+  }
+
+  for (size_t i; (i = next.fetch_add(1)) < inputs.size();) {
+    const Input &input = inputs[i];
+    Result &result = results[i];
+
+    {
+      LLVMContext Context;
+      SMDiagnostic Err;
+      std::unique_ptr<Module> M = parseIRFile(input.file, Err, Context);
+      if (!M) {
+        std::string msg;
+        raw_string_ostream os(msg);
+        Err.print("irhash-tool", os);
+        errs() << os.str();
+        continue;
+      }
+      const Hasher::Digest digest = IRHashPass::withKind(IRHashPass::hashModule(*M, 1, HashOptions::fromEnv()), Kind);
+      result.key = IRHashPass::withConfiguration(digest, Config).digest().str();
+      result.status = Result::Hashed;
+    }
+    if (!Populate) {
+      continue;
+    }
+
+    const std::string object(object_of(input));
+    if (!sys::fs::exists(object)) {
+      result.status = Result::NoObject;
+      continue;
+    }
+    if (cache->find_object_from_hash(object, result.key) != "") {
+      result.status = Result::Cached;
+      continue;
+    }
+
+    // Entries of kinds with further files are bundles of all of them, the
+    // files which don't exist are left out like the pass does
+    std::string src(object), bundle;
+    if (!Extras.empty()) {
+      ObjectCache::Artifacts artifacts{{"object", object}};
+      for (const ExtraRole *role : Extras) {
+        SmallString<256> path(object);
+        for (StringRef extension : role->second) {
+          sys::path::replace_extension(path, extension);
+          if (sys::fs::exists(path)) {
+            break;
+          }
+        }
+        artifacts.push_back({role->first.str(), std::string(path)});
+      }
+      bundle = ObjectCache::tmp_name((object + ".bundle").c_str());
+      unlink(bundle.c_str());
+      if (!ObjectCache::write_bundle(artifacts, bundle.c_str())) {
+        result.status = Result::StoreFailed;
+        continue;
+      }
+      src = bundle;
+    }
+
+    if (irhashd.connected() && irhashd.store(result.key, src.c_str())) {
+      result.status = Result::Stored;
+    } else {
+      std::unique_ptr<char, decltype(&free)> entry(cache->objectcopy_filename(object, result.key), free);
+      result.status = cache->store(src.c_str(), entry.get()) ? Result::Stored : Result::StoreFailed;
+    }
+    if (!bundle.empty()) {
+      unlink(bundle.c_str());
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash offline hashing and cache seeding\n");
+
+  if (Populate && Config.empty()) {
+    // Entries stored under a guessed configuration would never be found
+    errs() << "irhash-tool: -populate needs the -config of the compiler of the objects\n";
+    return 1;
+  }
+  if (Config.empty()) {
+    Config = IRHashPass::getConfiguration();
+  }
+  if (!extra_roles(Extras)) {
+    return 1;
+  }
+  if (Populate && CacheDir.empty()) {
+    if (const char *cachedir = getenv("IRHASH_CACHE")) {
+      CacheDir = cachedir;
+    } else {
+      errs() << "irhash-tool: no cache directory, set IRHASH_CACHE or -cache\n";
+      return 1;
+    }
+  }
+  if (Populate) {
+    // The cache to seed may not exist yet
+    sys::fs::create_directories(CacheDir);
+  }
+  if (Populate && !ObjectCache(CacheDir).check_algorithm(Hasher::Algorithm)) {
+    errs() << "irhash-tool: " << CacheDir << " holds keys of a different hash algorithm than " << Hasher::Algorithm
+           << '\n';
+    return 1;
+  }
+
+  std::vector<Input> inputs;
+  for (const std::string &arg : Inputs) {
+    collect(arg, inputs);
+  }
+
+  // Modules are hashed on one thread each, the threads take the next module
+  // when they are done, so large modules don't hold up the rest
+  std::vector<Result> results(inputs.size());
+  std::atomic<size_t> next(0);
+  const unsigned threads = std::max(1u, std::min<unsigned>(Threads ? Threads : std::thread::hardware_concurrency(),
+                                                           inputs.size()));
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++) {
+    pool.emplace_back(worker, std::cref(inputs), std::ref(results), std::ref(next));
+  }
+  worker(inputs, results, next);
+  for (std::thread &t : pool) {
+    t.join();
+  }
+
+  unsigned failed = 0, stored = 0, cached = 0, missing = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const Result &result = results[i];
+    switch (result.status) {
+    case Result::Failed:
+      failed++;
+      continue;
+    case Result::NoObject:
+      errs() << "irhash-tool: no object file " << object_of(inputs[i]) << '\n';
+      missing++;
+      break;
+    case Result::StoreFailed:
+      errs() << "irhash-tool: can't store " << object_of(inputs[i]) << '\n';
+      failed++;
+      break;
+    case Result::Stored:
+      stored++;
+      break;
+    case Result::Cached:
+      cached++;
+      break;
+    case Result::Hashed:
+      break;
+    }
+    outs() << result.key << ' ' << inputs[i].file << '\n';
+  }
+
+  if (Populate) {
+    errs() << "irhash-tool: " << inputs.size() << " modules, " << stored << " stored, " << cached
+           << " already cached, " << missing << " without object file, " << failed << " failed\n";
+  }
+  return failed ? 1 : 0;
+}
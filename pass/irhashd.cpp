@@ -0,0 +1,297 @@
+// irhashd: optional IRHash cache daemon.
+// Keeps the index of the cache directory in memory and answers the lookups and
+// stores of the pass over a Unix socket (see daemon.hpp), so compilations
+// don't touch the metadata of the cache directory for misses. Stores are
+// queued and written by a pool of threads, which account for them in batches.
+//
+// The cache directory and the socket are taken from IRHASH_CACHE and
+// IRHASH_DAEMON. The other IRHASH_* settings of the daemon apply to the
+// entries it stores.
+
+#include "daemon.hpp"
+#include "hash.hpp"
+#include "objectcache.hpp"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/CommandLine.h>
+
+#include <condition_variable>
+#include <csignal>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <thread>
+
+using namespace llvm;
+
+static cl::opt<unsigned> Threads("j", cl::init(2), cl::desc("Number of threads writing cache entries"));
+static cl::opt<unsigned> BatchSize("batch", cl::init(64),
+                                   cl::desc("Maximum number of stores a thread writes before accounting for them"));
+
+/// A store request: the object file, received as a descriptor.
+struct PendingStore {
+  std::string key;
+  int fd;
+};
+
+struct Daemon {
+  ObjectCache cache;
+
+  std::mutex lock; // protects everything below
+  std::condition_variable wake;
+  /// Known entries of the cache, with whether they are compressed.
+  /// Entries evicted by other processes are only noticed by the next lookup.
+  StringMap<bool> index;
+  /// Keys being stored, so that concurrent compilations with the same key
+  /// don't store the same entry twice.
+  StringSet<> storing;
+  std::vector<PendingStore> queue;
+
+  /// Serializes the updates of `INDEX` and `USAGE` after each batch, the
+  /// ObjectCache isn't thread-safe for them.
+  std::mutex account_lock;
+
+  /// Results of check_algorithm.
+  StringMap<bool> algorithms;
+  /// Number of hex digits in the keys of the algorithm of the cache, 0 until
+  /// it is known.
+  unsigned digits = 0;
+
+  Daemon(const char *cachedir) : cache(cachedir) {}
+
+  /// Create all shard directories and read their entries into the index.
+  void scan() {
+    for (unsigned shard = 0; shard < ObjectCache::Shards; shard++) {
+      char prefix[3];
+      snprintf(prefix, sizeof(prefix), "%02x", shard);
+      std::string dir(cache.m_cachedir + "/" + prefix);
+      mkdir(dir.c_str(), 0755);
+
+      DIR *d = opendir(dir.c_str());
+      if (!d) {
+        continue;
+      }
+      while (struct dirent *ent = readdir(d)) {
+        StringRef name;
+        bool compressed;
+        if (!ObjectCache::parse_entry(ent->d_name, name, compressed)) {
+          continue; // USAGE, temporary files
+        }
+        auto It = index.try_emplace((prefix + name).str(), compressed);
+        // Prefer the kind we store, like find_object_from_hash
+        if (!It.second && compressed == (cache.m_compress != 0)) {
+          It.first->second = compressed;
+        }
+      }
+      closedir(d);
+    }
+  }
+
+  void lookup(int client, StringRef algorithm, StringRef key) {
+    std::unique_lock<std::mutex> guard(lock);
+
+    auto Algo = algorithms.find(algorithm);
+    if (Algo == algorithms.end()) {
+      Algo = algorithms.try_emplace(algorithm, cache.check_algorithm(algorithm.str())).first;
+    }
+    if (!Algo->second) {
+      DaemonClient::send_message(client, "MISMATCH");
+      return;
+    }
+    digits = key_digits(algorithm);
+    if (!ObjectCache::is_key(key, digits)) {
+      guard.unlock();
+      errs() << "irhashd: invalid key: " << key << '\n';
+      DaemonClient::send_message(client, "MISS");
+      return;
+    }
+
+    auto It = index.find(key);
+    if (It == index.end()) {
+      guard.unlock();
+      DaemonClient::send_message(client, "MISS");
+      return;
+    }
+    const bool compressed = It->second;
+    const std::string path(cache.entry_path(key.str(), compressed));
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      // evicted behind our back
+      index.erase(It);
+      guard.unlock();
+      DaemonClient::send_message(client, "MISS");
+      return;
+    }
+    guard.unlock();
+
+    DaemonClient::send_message(client, compressed ? "HIT .o.zst" : "HIT .o", fd);
+    close(fd);
+  }
+
+  void store(StringRef key, int fd) {
+    std::lock_guard<std::mutex> guard(lock);
+    // The key becomes a path, so it must not contain anything but hex digits.
+    // irhash-tool stores without looking up, but records the algorithm first.
+    if (!digits) {
+      std::ifstream recorded(cache.m_cachedir + "/ALGORITHM");
+      std::string algorithm;
+      std::getline(recorded, algorithm);
+      digits = key_digits(algorithm);
+    }
+    if (!ObjectCache::is_key(key, digits)) {
+      errs() << "irhashd: invalid key: " << key << '\n';
+      close(fd);
+      return;
+    }
+    if (index.count(key) || !storing.insert(key).second) {
+      close(fd);
+      return;
+    }
+    queue.push_back({key.str(), fd});
+    wake.notify_one();
+  }
+
+  /// Write queued stores in batches of up to BatchSize.
+  /// The usage counters of every shard are only updated once per batch.
+  void writer() {
+    for (;;) {
+      std::vector<PendingStore> batch;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&]() { return !queue.empty(); });
+        const size_t n = std::min<size_t>(queue.size(), BatchSize);
+        batch.assign(queue.end() - n, queue.end());
+        queue.resize(queue.size() - n);
+      }
+
+      std::map<std::string, ObjectCache::UsageDelta> shards;
+      std::vector<bool> written(batch.size());
+      for (size_t i = 0; i < batch.size(); i++) {
+        const PendingStore &S = batch[i];
+        // Keys are unique in the queue, so the temporary names of the entries are too
+        std::string src("/proc/self/fd/" + std::to_string(S.fd));
+        std::string dst(cache.entry_path(S.key, cache.m_compress));
+        ObjectCache::UsageDelta delta;
+        written[i] = cache.write_entry(src.c_str(), dst.c_str(), delta);
+        close(S.fd);
+        if (written[i]) {
+          shards[cache.shard_dir(S.key)] += delta;
+        }
+      }
+      {
+        std::lock_guard<std::mutex> guard(account_lock);
+        for (size_t i = 0; i < batch.size(); i++) {
+          if (written[i]) {
+            cache.index_entry(cache.entry_path(batch[i].key, cache.m_compress).c_str());
+          }
+        }
+        for (const auto &[shard, delta] : shards) {
+          cache.account(shard, delta);
+        }
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      for (size_t i = 0; i < batch.size(); i++) {
+        storing.erase(batch[i].key);
+        if (written[i]) {
+          index[batch[i].key] = cache.m_compress != 0;
+        }
+      }
+    }
+  }
+
+  void handle(int client, StringRef request, int fd) {
+    StringRef command, args;
+    std::tie(command, args) = request.split(' ');
+    if (command == "LOOKUP") {
+      StringRef algorithm, key;
+      std::tie(algorithm, key) = args.split(' ');
+      lookup(client, algorithm, key);
+    } else if (command == "STORE" && fd >= 0) {
+      store(args, fd);
+      return;
+    } else {
+      errs() << "irhashd: invalid request: " << request << '\n';
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+};
+
+static const char *socket_path;
+
+static void stop(int) {
+  unlink(socket_path);
+  _exit(0);
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "IRHash cache daemon\n");
+
+  const char *cachedir = getenv("IRHASH_CACHE");
+  socket_path = getenv("IRHASH_DAEMON");
+  if (!cachedir || !socket_path) {
+    errs() << "irhashd: IRHASH_CACHE and IRHASH_DAEMON must be set\n";
+    return 1;
+  }
+
+  static Daemon server(cachedir);
+  server.scan();
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    errs() << "irhashd: socket path too long: " << socket_path << '\n';
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+  int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  unlink(socket_path);
+  if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 512) != 0) {
+    perror("irhashd: can't listen");
+    return 1;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (unsigned i = 0; i < std::max(1u, (unsigned)Threads); i++) {
+    std::thread([]() { server.writer(); }).detach();
+  }
+  outs() << "irhashd: " << server.index.size() << " entries in " << cachedir << ", listening on " << socket_path
+         << '\n';
+  outs().flush();
+
+  // Every compilation keeps its connection open until it exits
+  std::vector<struct pollfd> fds = {{listener, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      continue; // EINTR
+    }
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      char buf[DaemonClient::MaxMessage];
+      int fd;
+      ssize_t n = DaemonClient::receive_message(fds[i].fd, buf, sizeof(buf), &fd);
+      if (n > 0) {
+        server.handle(fds[i].fd, StringRef(buf, n), fd);
+      } else {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+      }
+    }
+    fds.erase(std::remove_if(fds.begin() + 1, fds.end(), [](const struct pollfd &p) { return p.fd < 0; }),
+              fds.end());
+
+    if (fds[0].revents & POLLIN) {
+      int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client >= 0) {
+        fds.push_back({client, POLLIN, 0});
+      }
+    }
+  }
+}
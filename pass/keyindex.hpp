@@ -0,0 +1,209 @@
+#ifndef IRHASH_KEYINDEX_HPP
+#define IRHASH_KEYINDEX_HPP
+
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <atomic>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+/// Set of the keys present in the cache, in the memory-mapped file
+/// `<cache>/INDEX`.
+///
+/// It's an open-addressing hash table with linear probing. Each slot is a
+/// single 64 bit word, so lookups are a few cache-line reads and concurrent
+/// processes insert and remove keys with compare-and-swap, without locks:
+///
+///   0                                      empty, ends a probe sequence
+///   Tombstone                              removed key
+///   fingerprint << 2 | compressed << 1 | 1  present key
+///
+/// The fingerprint is the first 62 bits of the key, which is a hash itself.
+/// Slots are never reused after a removal, so two processes inserting the
+/// same key always race for the same empty slot. Once 3/4 of the slots are
+/// used (present or removed), the present keys are copied to a new file with
+/// twice as many slots as keys, and the old one is marked as retired so that
+/// processes still mapping it switch over.
+struct KeyIndex {
+  static constexpr uint64_t Magic = 0x3130584449485249; // "IRHIDX01"
+  static constexpr uint64_t MinCapacity = 1 << 16;
+
+  static constexpr uint64_t Empty = 0;
+  static constexpr uint64_t Tombstone = 2;
+
+  struct Header {
+    uint64_t magic;
+    uint64_t capacity; // slots, a power of two
+    std::atomic<uint64_t> used; // slots which aren't empty
+    std::atomic<uint64_t> retired; // replaced by a new INDEX
+    uint64_t reserved[4]; // the slots start on a new cache line
+  };
+  static_assert(sizeof(Header) == 64, "INDEX header layout");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "slots are shared between processes");
+
+  Header *header = nullptr;
+  std::atomic<uint64_t> *slots = nullptr;
+  size_t mapped = 0;
+
+  KeyIndex() = default;
+  KeyIndex(const KeyIndex &) = delete;
+  KeyIndex &operator=(const KeyIndex &) = delete;
+  ~KeyIndex() { close(); }
+
+  static size_t file_size(uint64_t capacity) { return sizeof(Header) + capacity * sizeof(uint64_t); }
+
+  /// Map the index file \p path.
+  /// Fails if it doesn't exist or looks corrupt.
+  bool open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header)) {
+      map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+
+    header = (Header *)map;
+    slots = (std::atomic<uint64_t> *)(header + 1);
+    mapped = st.st_size;
+    const uint64_t capacity = header->capacity;
+    if (header->magic != Magic || capacity == 0 || (capacity & (capacity - 1)) ||
+        file_size(capacity) != (size_t)st.st_size) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (header) {
+      munmap(header, mapped);
+    }
+    header = nullptr;
+    slots = nullptr;
+    mapped = 0;
+  }
+
+  bool is_open() const { return header != nullptr; }
+
+  bool is_retired() const { return header->retired.load(std::memory_order_acquire); }
+
+  /// Create an empty index file \p path with \p capacity slots.
+  /// Callers create it under a temporary name and rename or link it into place.
+  static bool create(const std::string &path, uint64_t capacity) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    // The slots are zero (empty) in the sparse file
+    Header h = {Magic, capacity, {0}, {0}, {}};
+    bool ok = ftruncate(fd, file_size(capacity)) == 0 && pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+    return ::close(fd) == 0 && ok;
+  }
+
+  static uint64_t fingerprint(StringRef key) {
+    uint64_t fp;
+    if (key.size() < 16 || key.substr(0, 16).getAsInteger(16, fp)) {
+      fp = hash_value(key);
+    }
+    return fp << 2;
+  }
+
+  enum Lookup { Absent, Plain, Compressed };
+
+  Lookup lookup(StringRef key) const {
+    const uint64_t fp = fingerprint(key);
+    const uint64_t mask = header->capacity - 1;
+    for (uint64_t i = fp >> 2 & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+      const uint64_t slot = slots[i].load(std::memory_order_acquire);
+      if (slot == Empty) {
+        return Absent;
+      }
+      if ((slot & 1) && (slot & ~3ull) == fp) {
+        return slot & 2 ? Compressed : Plain;
+      }
+    }
+    return Absent;
+  }
+
+  /// Add \p key, or update whether it is \p compressed.
+  /// Fails if the table is too full or retired, it should be reopened or
+  /// resized then.
+  bool insert(StringRef key, bool compressed) { return insert_slot(fingerprint(key) | (compressed ? 2 : 0) | 1); }
+
+  /// Insert the present \p entry, as stored in a slot.
+  bool insert_slot(uint64_t entry) {
+    if (is_retired()) {
+      return false;
+    }
+    const uint64_t fp = entry & ~3ull;
+    const uint64_t mask = header->capacity - 1;
+    for (uint64_t i = fp >> 2 & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+      uint64_t slot = slots[i].load(std::memory_order_acquire);
+      while (slot == Empty) {
+        if (header->used.load(std::memory_order_relaxed) >= header->capacity / 4 * 3) {
+          return false;
+        }
+        if (slots[i].compare_exchange_weak(slot, entry, std::memory_order_acq_rel)) {
+          header->used.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+        // lost the slot to another writer, check what it inserted
+      }
+      if ((slot & 1) && (slot & ~3ull) == fp) {
+        slots[i].store(entry, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void remove(StringRef key) {
+    const uint64_t fp = fingerprint(key);
+    const uint64_t mask = header->capacity - 1;
+    for (uint64_t i = fp >> 2 & mask, n = 0; n <= mask; i = (i + 1) & mask, n++) {
+      uint64_t slot = slots[i].load(std::memory_order_acquire);
+      if (slot == Empty) {
+        return;
+      }
+      if ((slot & 1) && (slot & ~3ull) == fp) {
+        slots[i].compare_exchange_strong(slot, Tombstone, std::memory_order_acq_rel);
+        return;
+      }
+    }
+  }
+
+  /// Insert all present keys of \p other.
+  void copy_from(const KeyIndex &other) {
+    for (uint64_t i = 0; i < other.header->capacity; i++) {
+      const uint64_t slot = other.slots[i].load(std::memory_order_acquire);
+      if (slot & 1) {
+        insert_slot(slot);
+      }
+    }
+  }
+
+  /// Number of present keys.
+  uint64_t count() const {
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < header->capacity; i++) {
+      n += slots[i].load(std::memory_order_relaxed) & 1;
+    }
+    return n;
+  }
+};
+
+#endif // IRHASH_KEYINDEX_HPP
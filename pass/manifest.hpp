@@ -0,0 +1,123 @@
+#ifndef IRHASH_MANIFEST_HPP
+#define IRHASH_MANIFEST_HPP
+
+#include "hash.hpp"
+#include "objectcache.hpp"
+
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// Manifest of the direct mode, which maps the inputs of a compilation to
+/// the key of the IR it produced.
+///
+/// The manifest of a compilation is found by a digest of its command line,
+/// main source file and the HashOptions of the key, at
+/// `<cache>/manifests/<hh>/<rest>`. It holds the key of
+/// the IR and the digests of all other files the compilation read, one per
+/// line:
+///
+///   <IR key>
+///   <digest> <kind> <path>
+///
+/// If all of these files are unchanged, the compilation produces the same IR
+/// again. Every compilation replaces the manifest it found.
+struct Manifest {
+  /// What a file is to the compilation.
+  enum Kind : char {
+    UserHeader = 'u',
+    SystemHeader = 's',
+    Extra = 'x', // other inputs listed in the dependency file, e.g. sanitizer ignore lists
+    Hidden = 'h' // inputs not listed there, e.g. profiles
+  };
+
+  struct Input {
+    std::string digest;
+    Kind kind;
+    std::string path;
+  };
+
+  std::string key; // of the IR
+  std::vector<Input> inputs;
+
+  static std::string path(const std::string &cachedir, StringRef digest) {
+    return cachedir + "/manifests/" + digest.substr(0, 2).str() + "/" + digest.substr(2).str();
+  }
+
+  static std::string digest_of(StringRef data) { return Hasher::hash(data).digest().str().str(); }
+
+  /// Digest of the current contents of the file \p path, empty if it can't be read.
+  static std::string digest_of_file(const std::string &path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path, /*IsText=*/false,
+                                                                          /*RequiresNullTerminator=*/false);
+    return buffer ? digest_of((*buffer)->getBuffer()) : "";
+  }
+
+  void add(StringRef data, Kind kind, StringRef path) { inputs.push_back({digest_of(data), kind, path.str()}); }
+
+  bool add_file(const std::string &path, Kind kind) {
+    std::string digest(digest_of_file(path));
+    if (digest.empty()) {
+      return false;
+    }
+    inputs.push_back({std::move(digest), kind, path});
+    return true;
+  }
+
+  bool read(const std::string &file) {
+    std::ifstream in(file);
+    if (!std::getline(in, key) || key.empty()) {
+      return false;
+    }
+    inputs.clear();
+    for (std::string line; std::getline(in, line);) {
+      // Paths may contain spaces, they are the rest of the line
+      StringRef rest(line);
+      auto [digest, tail] = rest.split(' ');
+      if (digest.empty() || tail.size() < 3 || tail[1] != ' ') {
+        return false;
+      }
+      inputs.push_back({digest.str(), (Kind)tail[0], tail.drop_front(2).str()});
+    }
+    return true;
+  }
+
+  /// Do all inputs still have the contents they had when the manifest was written?
+  bool up_to_date() const {
+    for (const Input &input : inputs) {
+      if (digest_of_file(input.path) != input.digest) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Write the manifest to \p file, replacing the previous one atomically.
+  bool write(const std::string &file) const {
+    const std::string dir(file.substr(0, file.rfind('/')));
+    mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+
+    const std::string tmp(ObjectCache::tmp_name(file.c_str()));
+    {
+      std::ofstream out(tmp);
+      out << key << '\n';
+      for (const Input &input : inputs) {
+        out << input.digest << ' ' << (char)input.kind << ' ' << input.path << '\n';
+      }
+      if (!out.good()) {
+        unlink(tmp.c_str());
+        return false;
+      }
+    }
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif // IRHASH_MANIFEST_HPP
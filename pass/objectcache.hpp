@@ -3,29 +3,810 @@
 
 #include <llvm/Passes/PassPlugin.h>
 
+#include <zstd.h>
+
+#include "keyindex.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/fs.h>
 #include <string>
+#include <sys/file.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 using namespace llvm;
 
 struct ObjectCache {
+  /// Entries are spread over 256 shard directories by the first two hex
+  /// digits of their key.
+  static constexpr unsigned Shards = 256;
+
   std::string m_cachedir;
+  uint64_t m_maxsize = 0;  // in bytes, 0 = unlimited
+  uint64_t m_maxfiles = 0; // 0 = unlimited
+  int m_compress = 0;       // zstd level, 0 = store uncompressed
+
+  KeyIndex m_index;
+  bool m_index_opened = false;
+
+  ObjectCache(std::string cachedir) : m_cachedir(cachedir) {
+    if (const char *maxsize = getenv("IRHASH_MAXSIZE")) {
+      m_maxsize = parse_size("IRHASH_MAXSIZE", maxsize);
+    }
+    if (const char *maxfiles = getenv("IRHASH_MAXFILES")) {
+      if (StringRef(maxfiles).getAsInteger(10, m_maxfiles)) {
+        report_fatal_error("IRHASH_MAXFILES is not a number");
+      }
+    }
+    if (const char *compress = getenv("IRHASH_COMPRESS")) {
+      if (StringRef(compress).getAsInteger(10, m_compress)) {
+        report_fatal_error("IRHASH_COMPRESS is not a number");
+      }
+    }
+  }
+
+  /// Temporary file next to \p path, to be renamed to \p path when complete.
+  static std::string tmp_name(const char *path) { return std::string(path) + ".tmp." + std::to_string(getpid()); }
+
+  static bool is_compressed(StringRef path) { return path.ends_with(".zst"); }
+
+  /// Split the file name \p name of a cache entry into the rest of its key
+  /// (after the shard) and whether it is \p compressed.
+  /// Fails for other files in the shard directories.
+  static bool parse_entry(StringRef name, StringRef &rest, bool &compressed) {
+    compressed = name.consume_back(".o.zst");
+    if (!compressed && !name.consume_back(".o")) {
+      return false;
+    }
+    rest = name;
+    return true;
+  }
+
+  /// Whether \p key is \p digits lowercase hex digits, as entry_path()
+  /// expects of keys.
+  static bool is_key(StringRef key, unsigned digits) {
+    return digits && key.size() == digits && key.find_first_not_of("0123456789abcdef") == StringRef::npos;
+  }
+
+  /// The key index of the cache, or nullptr if it has none.
+  KeyIndex *index() {
+    if (!m_index_opened || (m_index.is_open() && m_index.is_retired())) {
+      m_index_opened = true;
+      m_index.open(m_cachedir + "/INDEX");
+    }
+    return m_index.is_open() ? &m_index : nullptr;
+  }
+
+  /// Replace `INDEX` by a new one with \p capacity slots, filled by \p fill.
+  /// The keys of the old index are copied over again after the new one is in
+  /// place, to pick up keys inserted in the meantime.
+  template <typename Fill>
+  bool replace_index(uint64_t capacity, Fill fill) {
+    KeyIndex *old = index();
+    const std::string path(m_cachedir + "/INDEX");
+    const std::string tmp(tmp_name(path.c_str()));
+    KeyIndex fresh;
+    if (!KeyIndex::create(tmp, capacity) || !fresh.open(tmp)) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    fill(fresh);
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    if (old) {
+      fresh.copy_from(*old);
+      old->header->retired.store(1, std::memory_order_release);
+    }
+    m_index_opened = false;
+    return true;
+  }
+
+  /// Copy the present keys of a full `INDEX` into a new one, sized like
+  /// rebuild_index() does. Removed keys still use slots, so with eviction the
+  /// new index has the same or fewer slots unless the present keys grew.
+  bool resize_index() {
+    KeyIndex *old = index();
+    if (!old) {
+      return false;
+    }
+    const uint64_t capacity = std::max(KeyIndex::MinCapacity, (uint64_t)PowerOf2Ceil(old->count() * 2));
+    return replace_index(capacity, [&](KeyIndex &fresh) { fresh.copy_from(*old); });
+  }
+
+  /// Regenerate `INDEX` from the entries in the shard directories.
+  bool rebuild_index() {
+    std::vector<std::pair<std::string, bool>> keys;
+    for (unsigned shard = 0; shard < Shards; shard++) {
+      char prefix[3];
+      snprintf(prefix, sizeof(prefix), "%02x", shard);
+      DIR *dir = opendir((m_cachedir + "/" + prefix).c_str());
+      if (!dir) {
+        continue;
+      }
+      while (struct dirent *ent = readdir(dir)) {
+        StringRef rest;
+        bool compressed;
+        if (parse_entry(ent->d_name, rest, compressed)) {
+          keys.push_back({(prefix + rest).str(), compressed});
+        }
+      }
+      closedir(dir);
+    }
+
+    // Keep it at most half full
+    const uint64_t capacity = std::max(KeyIndex::MinCapacity, (uint64_t)PowerOf2Ceil(keys.size() * 2));
+    return replace_index(capacity, [&](KeyIndex &fresh) {
+      for (const auto &[key, compressed] : keys) {
+        fresh.insert(key, compressed);
+      }
+    });
+  }
+
+  /// Check that the keys in the cache were produced by \p algorithm.
+  /// The first plugin to use the cache directory records its algorithm there.
+  bool check_algorithm(std::string algorithm) {
+    std::string path(m_cachedir + "/ALGORITHM");
+
+    std::ifstream recorded(path);
+    if (!recorded.good()) {
+      // A new cache gets an empty key index before anything can be stored
+      std::string index(m_cachedir + "/INDEX");
+      std::string tmpindex(tmp_name(index.c_str()));
+      if (KeyIndex::create(tmpindex, KeyIndex::MinCapacity)) {
+        link(tmpindex.c_str(), index.c_str());
+      }
+      unlink(tmpindex.c_str());
+
+      // Publish with link() so concurrent compilations agree on a single winner
+      std::string tmp(tmp_name(path.c_str()));
+      {
+        std::ofstream out(tmp);
+        out << algorithm << '\n';
+      }
+      int ret = link(tmp.c_str(), path.c_str());
+      unlink(tmp.c_str());
+      if (ret == 0) {
+        return true;
+      }
+      recorded.open(path);
+    }
+
+    std::string line;
+    std::getline(recorded, line);
+    return line == algorithm;
+  }
+
+  /// Copy the open file \p srcfd to the new file \p dst.
+  /// Tries a reflink (FICLONE) first, then copy_file_range, then read/write.
+  static bool copy_file(int srcfd, const char *dst) {
+    struct stat st;
+    if (fstat(srcfd, &st) != 0) {
+      return false;
+    }
+    int dstfd = open(dst, O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 0666);
+    if (dstfd < 0) {
+      return false;
+    }
+
+    bool ok = ioctl(dstfd, FICLONE, srcfd) == 0;
+    if (!ok) {
+      loff_t in = 0, out = 0;
+      while (in < st.st_size) {
+        ssize_t n = copy_file_range(srcfd, &in, dstfd, &out, st.st_size - in, 0);
+        if (n <= 0) {
+          break;
+        }
+      }
+      ok = in == st.st_size;
+    }
+    if (!ok) {
+      // e.g. EXDEV on older kernels, start over with a plain copy
+      char buf[1 << 16];
+      off_t off = 0;
+      ssize_t n;
+      while ((n = pread(srcfd, buf, sizeof(buf), off)) > 0 && pwrite(dstfd, buf, n, off) == n) {
+        off += n;
+      }
+      ok = n == 0 && ftruncate(dstfd, off) == 0;
+    }
+
+    if (close(dstfd) != 0 || !ok) {
+      unlink(dst);
+      return false;
+    }
+    return true;
+  }
+
+  /// Atomically replace \p dst with the content of \p src.
+  /// The file is hardlinked, or copied if that fails (e.g. across
+  /// filesystems), to a temporary name next to \p dst and renamed over it.
+  static bool publish(const char *src, const char *dst) {
+    std::string tmp(tmp_name(dst));
+    unlink(tmp.c_str());
+
+    // Follow \p src if it is a /proc/self/fd link, to link the file itself
+    if (linkat(AT_FDCWD, src, AT_FDCWD, tmp.c_str(), AT_SYMLINK_FOLLOW) != 0) {
+      int srcfd = open(src, O_RDONLY);
+      if (srcfd < 0) {
+        return false;
+      }
+      bool ok = copy_file(srcfd, tmp.c_str());
+      close(srcfd);
+      if (!ok) {
+        return false;
+      }
+    }
+
+    bool ok = rename(tmp.c_str(), dst) == 0;
+    // rename does nothing if both names are already links to the same file
+    unlink(tmp.c_str());
+    return ok;
+  }
+
+  /// Compress \p src with zstd into the new cache entry \p dst.
+  /// The uncompressed size is recorded in the frame header.
+  bool compress(const char *src, const char *dst) const {
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+      close(in);
+      return false;
+    }
+    std::string tmp(tmp_name(dst));
+    unlink(tmp.c_str());
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 0666);
+    if (out < 0) {
+      close(in);
+      return false;
+    }
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, m_compress);
+    ZSTD_CCtx_setPledgedSrcSize(cctx, st.st_size);
+    std::vector<char> inbuf(ZSTD_CStreamInSize()), outbuf(ZSTD_CStreamOutSize());
+
+    bool ok = true;
+    ssize_t n;
+    do {
+      n = read(in, inbuf.data(), inbuf.size());
+      if (n < 0) {
+        ok = false;
+        break;
+      }
+      const ZSTD_EndDirective mode = n == 0 ? ZSTD_e_end : ZSTD_e_continue;
+      ZSTD_inBuffer input = {inbuf.data(), (size_t)n, 0};
+      size_t remaining;
+      do {
+        ZSTD_outBuffer output = {outbuf.data(), outbuf.size(), 0};
+        remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+        if (ZSTD_isError(remaining) || write(out, outbuf.data(), output.pos) != (ssize_t)output.pos) {
+          ok = false;
+          break;
+        }
+      } while (mode == ZSTD_e_end ? remaining != 0 : input.pos != input.size);
+    } while (ok && n != 0);
+    ZSTD_freeCCtx(cctx);
+    close(in);
+
+    if (close(out) != 0 || !ok || rename(tmp.c_str(), dst) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /// Atomically replace \p dst with the decompressed cache entry \p src.
+  static bool decompress(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+      return false;
+    }
+    std::string tmp(tmp_name(dst));
+    unlink(tmp.c_str());
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (out < 0) {
+      close(in);
+      return false;
+    }
+
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    std::vector<char> inbuf(ZSTD_DStreamInSize()), outbuf(ZSTD_DStreamOutSize());
+
+    bool ok = true;
+    size_t remaining = 1; // nonzero until the end of the frame
+    ssize_t n;
+    while (ok && (n = read(in, inbuf.data(), inbuf.size())) > 0) {
+      ZSTD_inBuffer input = {inbuf.data(), (size_t)n, 0};
+      while (input.pos < input.size) {
+        ZSTD_outBuffer output = {outbuf.data(), outbuf.size(), 0};
+        remaining = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(remaining) || write(out, outbuf.data(), output.pos) != (ssize_t)output.pos) {
+          ok = false;
+          break;
+        }
+      }
+    }
+    ZSTD_freeDCtx(dctx);
+    close(in);
+
+    if (close(out) != 0 || !ok || n != 0 || remaining != 0 || rename(tmp.c_str(), dst) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /// Atomically replace the object file \p dst with the cache entry \p src.
+  static bool restore(const char *src, const char *dst) { return restore(src, dst, is_compressed(src)); }
+
+  /// Same, for an entry whose name doesn't tell if it is \p compressed, e.g.
+  /// a descriptor received from irhashd.
+  static bool restore(const char *src, const char *dst, bool compressed) {
+    return compressed ? decompress(src, dst) : publish(src, dst);
+  }
+
+  /// Files of an output: their role, e.g. "object" or "dwo", and path.
+  using Artifacts = std::vector<std::pair<std::string, std::string>>;
+
+  /// Entries of outputs with further files, e.g. split DWARF, are bundles of
+  /// all of them, so they are stored, restored and evicted as one:
+  ///
+  ///   "IRHBDL01" <count> (<role length> <role> <size>)... <contents>...
+  ///
+  /// Counts and lengths are 32 bit, sizes 64 bit, in host byte order. Files
+  /// the compiler didn't write aren't part of the bundle.
+  static constexpr char BundleMagic[8] = {'I', 'R', 'H', 'B', 'D', 'L', '0', '1'};
 
-  ObjectCache(std::string cachedir) : m_cachedir(cachedir) {}
+  /// Copy \p size bytes at \p offset of \p srcfd to the end of \p dstfd.
+  static bool copy_range(int srcfd, loff_t offset, uint64_t size, int dstfd) {
+    while (size > 0) {
+      ssize_t n = copy_file_range(srcfd, &offset, dstfd, nullptr, size, 0);
+      if (n <= 0) {
+        // e.g. EXDEV on older kernels
+        char buf[1 << 16];
+        n = pread(srcfd, buf, std::min<uint64_t>(size, sizeof(buf)), offset);
+        if (n <= 0 || write(dstfd, buf, n) != n) {
+          return false;
+        }
+        offset += n;
+      }
+      size -= n;
+    }
+    return true;
+  }
+
+  /// Bundle the files \p artifacts into the new file \p dst.
+  static bool write_bundle(const Artifacts &artifacts, const char *dst) {
+    std::vector<std::pair<int, uint64_t>> files; // descriptor and size
+    std::string header(BundleMagic, sizeof(BundleMagic));
+    auto append = [&](const auto &value) { header.append((const char *)&value, sizeof(value)); };
+    append((uint32_t)0);
+    bool ok = true;
+    for (const auto &[role, path] : artifacts) {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+        ok = ok && fd < 0 && errno == ENOENT;
+        if (fd >= 0) {
+          close(fd);
+        }
+        continue;
+      }
+      files.push_back({fd, st.st_size});
+      append((uint32_t)role.size());
+      header += role;
+      append((uint64_t)st.st_size);
+    }
+    const uint32_t count = files.size();
+    memcpy(&header[sizeof(BundleMagic)], &count, sizeof(count));
+
+    int out = ok ? open(dst, O_WRONLY | O_CREAT | O_EXCL, 0644) : -1;
+    ok = out >= 0 && write(out, header.data(), header.size()) == (ssize_t)header.size();
+    for (const auto &[fd, size] : files) {
+      ok = ok && copy_range(fd, 0, size, out);
+      close(fd);
+    }
+    if ((out >= 0 && close(out) != 0) || !ok) {
+      if (out >= 0) {
+        unlink(dst);
+      }
+      return false;
+    }
+    return true;
+  }
+
+  /// Replace the files \p artifacts with those in the bundle \p src. All of
+  /// them are extracted to temporary files before the first one is renamed.
+  static bool restore_bundle(const char *src, bool compressed, const Artifacts &artifacts) {
+    if (artifacts.empty()) {
+      return false;
+    }
+    int in;
+    if (compressed) {
+      const std::string plain(tmp_name((artifacts[0].second + ".bundle").c_str()));
+      in = decompress(src, plain.c_str()) ? open(plain.c_str(), O_RDONLY) : -1;
+      unlink(plain.c_str());
+    } else {
+      in = open(src, O_RDONLY);
+    }
+    if (in < 0) {
+      return false;
+    }
+
+    // The header, then the contents in the same order
+    char magic[sizeof(BundleMagic)];
+    uint32_t count = 0;
+    loff_t offset = 0;
+    auto read_value = [&](void *value, size_t size) {
+      const bool ok = pread(in, value, size, offset) == (ssize_t)size;
+      offset += size;
+      return ok;
+    };
+    bool ok = read_value(magic, sizeof(magic)) && !memcmp(magic, BundleMagic, sizeof(magic)) &&
+              read_value(&count, sizeof(count));
+    std::vector<std::pair<const std::string *, uint64_t>> files; // path and size
+    for (uint32_t i = 0; ok && i < count; i++) {
+      uint32_t length;
+      std::string role;
+      uint64_t size;
+      ok = read_value(&length, sizeof(length)) && length < 256;
+      if (ok) {
+        role.resize(length);
+        ok = read_value(&role[0], length) && read_value(&size, sizeof(size));
+      }
+      auto artifact = std::find_if(artifacts.begin(), artifacts.end(), [&](const auto &a) { return a.first == role; });
+      ok = ok && artifact != artifacts.end();
+      if (ok) {
+        files.push_back({&artifact->second, size});
+      }
+    }
+
+    std::vector<std::string> tmps;
+    for (const auto &[path, size] : files) {
+      if (!ok) {
+        break;
+      }
+      tmps.push_back(tmp_name(path->c_str()));
+      unlink(tmps.back().c_str());
+      int out = open(tmps.back().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+      ok = out >= 0 && copy_range(in, offset, size, out);
+      ok = out >= 0 && close(out) == 0 && ok;
+      offset += size;
+    }
+    close(in);
+    for (size_t i = 0; i < tmps.size(); i++) {
+      ok = ok && rename(tmps[i].c_str(), files[i].first->c_str()) == 0;
+    }
+    for (const std::string &tmp : tmps) {
+      unlink(tmp.c_str());
+    }
+    return ok;
+  }
+
+  /// Uncompressed size of the cache entry \p path of \p size bytes.
+  static uint64_t raw_size(const std::string &path, uint64_t size) {
+    if (!is_compressed(path)) {
+      return size;
+    }
+    char header[18]; // ZSTD_FRAMEHEADERSIZE_MAX, which is only in the static API
+    int fd = open(path.c_str(), O_RDONLY);
+    ssize_t n = fd < 0 ? -1 : pread(fd, header, sizeof(header), 0);
+    if (fd >= 0) {
+      close(fd);
+    }
+    unsigned long long raw = n < 0 ? ZSTD_CONTENTSIZE_ERROR : ZSTD_getFrameContentSize(header, n);
+    return raw == ZSTD_CONTENTSIZE_ERROR || raw == ZSTD_CONTENTSIZE_UNKNOWN ? size : raw;
+  }
+
+  /// Store the object file \p src as the cache entry \p dst and account for
+  /// it in the usage counters of its shard.
+  /// With \p async, an entry which must be compressed or can't be hardlinked
+  /// because the cache is on another filesystem is written by a detached child
+  /// process.
+  bool store(const char *src, const char *dst, bool async = false) {
+    const std::string shard(shard_of(dst));
+
+    struct stat srcst, shardst;
+    if (stat(src, &srcst) != 0) {
+      return false;
+    }
+    if (async && (m_compress || (stat(shard.c_str(), &shardst) == 0 && shardst.st_dev != srcst.st_dev))) {
+      // Open it now, the object file may be replaced after the compiler exited
+      int srcfd = open(src, O_RDONLY);
+      pid_t pid = srcfd < 0 ? -1 : fork();
+      if (pid > 0) {
+        close(srcfd);
+        return true;
+      }
+      if (pid == 0) {
+        // Don't hold the compiler's output pipes open, build tools wait for them
+        setsid();
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        std::string fdpath("/proc/self/fd/" + std::to_string(srcfd));
+        _exit(store(fdpath.c_str(), dst) ? 0 : 1);
+      }
+      // no fork: store synchronously
+    }
+
+    UsageDelta delta;
+    if (!write_entry(src, dst, delta)) {
+      return false;
+    }
+    index_entry(dst);
+    account(shard, delta);
+    return true;
+  }
+
+  /// Change of the usage counters of a shard.
+  struct UsageDelta {
+    int64_t bytes = 0;
+    int64_t entries = 0;
+    int64_t raw_bytes = 0;
+
+    UsageDelta &operator+=(const UsageDelta &other) {
+      bytes += other.bytes;
+      entries += other.entries;
+      raw_bytes += other.raw_bytes;
+      return *this;
+    }
+  };
+
+  /// Write the object file \p src to the cache entry \p dst.
+  /// The caller indexes the entry and accounts for the returned \p delta, so
+  /// that irhashd can do that once for a whole batch of stores.
+  bool write_entry(const char *src, const char *dst, UsageDelta &delta) const {
+    struct stat srcst;
+    if (stat(src, &srcst) != 0) {
+      return false;
+    }
+    struct stat old;
+    const bool existed = stat(dst, &old) == 0;
+    const uint64_t oldsize = existed ? old.st_size : 0;
+    const uint64_t oldraw = existed ? raw_size(dst, old.st_size) : 0;
+    if (!(m_compress ? compress(src, dst) : publish(src, dst))) {
+      return false;
+    }
+    struct stat st;
+    const uint64_t size = stat(dst, &st) == 0 ? st.st_size : srcst.st_size;
+    delta.bytes = size - oldsize;
+    delta.raw_bytes = srcst.st_size - oldraw;
+    delta.entries = existed ? 0 : 1;
+    return true;
+  }
+
+  /// Add the new cache entry \p path to the key index, if there is one.
+  void index_entry(const char *path) {
+    const std::string key(entry_key(path));
+    for (int attempt = 0; attempt < 3; attempt++) {
+      KeyIndex *idx = index();
+      if (!idx || idx->insert(key, is_compressed(path))) {
+        return;
+      }
+      // Full: the first process to notice resizes it, the others wait for that
+      int lock = open((m_cachedir + "/INDEX").c_str(), O_RDONLY | O_CLOEXEC);
+      if (lock >= 0 && flock(lock, LOCK_EX) == 0 && !idx->is_retired()) {
+        resize_index();
+      }
+      if (lock >= 0) {
+        close(lock);
+      }
+    }
+  }
+
+  /// Key of the cache entry \p path.
+  static std::string entry_key(StringRef path) {
+    StringRef name = path.substr(path.rfind('/') + 1);
+    StringRef shard = path.substr(0, path.rfind('/'));
+    shard = shard.substr(shard.rfind('/') + 1);
+    StringRef rest;
+    bool compressed;
+    parse_entry(name, rest, compressed);
+    return (shard + rest).str();
+  }
+
+  /// Shard directory of the cache entry \p path.
+  static std::string shard_of(const char *path) { return std::string(path, strrchr(path, '/') - path); }
+
+  /// Usage counters of a shard directory, kept in `<shard>/USAGE`.
+  struct Usage {
+    uint64_t bytes = 0;     // on disk
+    uint64_t entries = 0;
+    uint64_t raw_bytes = 0; // uncompressed
+  };
+
+  /// Sum of the usage counters of all shards.
+  Usage total_usage() const {
+    Usage total;
+    for (unsigned shard = 0; shard < Shards; shard++) {
+      char prefix[3];
+      snprintf(prefix, sizeof(prefix), "%02x", shard);
+      int fd = open((m_cachedir + "/" + prefix + "/USAGE").c_str(), O_RDONLY | O_CLOEXEC);
+      Usage usage;
+      if (fd >= 0 && pread(fd, &usage, sizeof(usage), 0) >= 0) {
+        total.bytes += usage.bytes;
+        total.entries += usage.entries;
+        total.raw_bytes += usage.raw_bytes;
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+    return total;
+  }
+
+  /// Add to the usage counters of \p shard.
+  /// If the shard now exceeds its share of the limits, its least recently
+  /// used entries are evicted. Only this shard is scanned for that.
+  void account(const std::string &shard, const UsageDelta &delta) {
+    int fd = open((shard + "/USAGE").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      return;
+    }
+    flock(fd, LOCK_EX);
+
+    // Counters missing in older USAGE files stay zero
+    Usage usage;
+    if (pread(fd, &usage, sizeof(usage), 0) < 0) {
+      usage = Usage();
+    }
+    usage.bytes = std::max<int64_t>(0, usage.bytes + delta.bytes);
+    usage.raw_bytes = std::max<int64_t>(0, usage.raw_bytes + delta.raw_bytes);
+    usage.entries = std::max<int64_t>(0, usage.entries + delta.entries);
+    if (exceeds(usage, 1.0)) {
+      usage = evict(shard);
+    }
+    pwrite(fd, &usage, sizeof(usage), 0);
+
+    close(fd); // unlocks
+  }
+
+  /// Whether \p usage is above \p fraction of the per-shard limits.
+  /// A shard always keeps at least one entry, so an IRHASH_MAXFILES below the
+  /// number of shards is rounded up to it.
+  bool exceeds(const Usage &usage, double fraction) const {
+    return (m_maxsize && usage.bytes > fraction * m_maxsize / Shards) ||
+           (m_maxfiles && usage.entries > std::max(1.0, fraction * m_maxfiles / Shards));
+  }
+
+  /// Remove the least recently used entries of \p shard until it is below 90%
+  /// of its share of the limits. Hits bump the mtime of an entry, so that's
+  /// the time of its last use.
+  /// Returns the remaining usage, counted from the directory itself.
+  Usage evict(const std::string &shard) {
+    struct Entry {
+      struct timespec mtime;
+      uint64_t size, raw_size;
+      std::string path;
+    };
+    std::vector<Entry> entries;
+    Usage usage;
+
+    DIR *dir = opendir(shard.c_str());
+    if (!dir) {
+      return usage;
+    }
+    const time_t now = time(nullptr);
+    while (struct dirent *ent = readdir(dir)) {
+      std::string path(shard + "/" + ent->d_name);
+      struct stat st;
+      if (ent->d_name[0] == '.' || !strcmp(ent->d_name, "USAGE") || lstat(path.c_str(), &st) != 0 ||
+          !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      if (strstr(ent->d_name, ".tmp.")) {
+        // left behind by a crashed store
+        if (st.st_mtime < now - 3600) {
+          unlink(path.c_str());
+        }
+        continue;
+      }
+      entries.push_back({st.st_mtim, (uint64_t)st.st_size, raw_size(path, st.st_size), path});
+      usage.bytes += st.st_size;
+      usage.raw_bytes += entries.back().raw_size;
+      usage.entries++;
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+      return a.mtime.tv_sec < b.mtime.tv_sec || (a.mtime.tv_sec == b.mtime.tv_sec && a.mtime.tv_nsec < b.mtime.tv_nsec);
+    });
+    for (const Entry &e : entries) {
+      if (!exceeds(usage, 0.9)) {
+        break;
+      }
+      if (unlink(e.path.c_str()) == 0) {
+        if (KeyIndex *idx = index()) {
+          idx->remove(entry_key(e.path));
+        }
+        usage.bytes -= e.size;
+        usage.raw_bytes -= e.raw_size;
+        usage.entries--;
+      }
+    }
+    return usage;
+  }
+
+  /// Parse a size like `500M` or `10G`.
+  static uint64_t parse_size(const char *env, const char *value) {
+    uint64_t size;
+    StringRef str(value);
+    size_t digits = str.find_first_not_of("0123456789");
+    if (str.substr(0, digits).getAsInteger(10, size)) {
+      report_fatal_error(Twine(env) + " is not a size");
+    }
+    StringRef suffix = str.substr(digits);
+    for (const char *units = "KMGT"; *units && !suffix.empty(); units++) {
+      size *= 1024;
+      if (suffix.equals_insensitive(StringRef(units, 1))) {
+        return size;
+      }
+    }
+    if (!suffix.empty()) {
+      report_fatal_error(Twine(env) + " is not a size");
+    }
+    return size;
+  }
+
+  /// Directory of the shard of \p hash.
+  std::string shard_dir(const std::string &hash) const { return m_cachedir + "/" + hash.substr(0, 2); }
+
+  /// Path of the cache entry of \p hash.
+  std::string entry_path(const std::string &hash, bool compressed) const {
+    return shard_dir(hash) + "/" + hash.substr(2) + (compressed ? ".o.zst" : ".o");
+  }
 
   char *objectcopy_filename(std::string objectfile, std::string hash) {
-    std::string dir(m_cachedir + "/" + hash.substr(0, 2));
-    mkdir(dir.c_str(), 0755);
-    std::string path(dir + "/" + hash.substr(2) + ".o");
-    return strdup(path.c_str());
+    mkdir(shard_dir(hash).c_str(), 0755);
+    return strdup(entry_path(hash, m_compress).c_str());
   }
 
   std::string find_object_from_hash(std::string objectfile, std::string hash) {
-    std::string ObjectPath(m_cachedir + "/" + hash.substr(0, 2) + "/" + hash.substr(2) + ".o");
+    if (KeyIndex *idx = index()) {
+      // Misses don't touch the shard directories at all. A hit is confirmed
+      // on disk: the entry is only read when the compiler exits, so it must
+      // not be a key which was removed behind the index's back.
+      const KeyIndex::Lookup found = idx->lookup(hash);
+      if (found == KeyIndex::Absent) {
+        return "";
+      }
+      std::string path(entry_path(hash, found == KeyIndex::Compressed));
+      struct stat dummy;
+      if (stat(path.c_str(), &dummy) != 0) {
+        idx->remove(hash);
+        return "";
+      }
+      return path;
+    }
+
+    std::string ObjectPath(entry_path(hash, false));
+    std::string CompressedPath(entry_path(hash, true));
+    // Look for the kind of entry we would store first
+    const std::string *candidates[2] = {&ObjectPath, &CompressedPath};
+    if (m_compress) {
+      std::swap(candidates[0], candidates[1]);
+    }
     struct stat dummy;
-    if (stat(ObjectPath.c_str(), &dummy) == 0) {
-      // Found!
-      return ObjectPath;
+    for (const std::string *candidate : candidates) {
+      const std::string &path = *candidate;
+      if (stat(path.c_str(), &dummy) == 0) {
+        // Found!
+        return path;
+      }
     }
     return "";
   }
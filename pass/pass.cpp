@@ -1,73 +1,378 @@
 #include "pass.hpp"
-#include "SlotTracker.hpp"
 
 #ifdef WITH_CLANG_PLUGIN
 #include "plugin.hpp"
+#include <clang/Basic/Sanitizers.h>
+#include <clang/Basic/TargetOptions.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Lex/Preprocessor.h>
 #endif
 
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/BinaryFormat/Magic.h>
 #include <llvm/Config/llvm-config.h>
+#include <llvm/IR/DebugInfo.h>
 #include <llvm/IR/InlineAsm.h>
 #include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Passes/PassPlugin.h>
-
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/TargetParser/Host.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#ifdef VALIDATION
+#include <dlfcn.h>
+#endif
 #include <fstream> // IWYU pragma: keep
+#include <thread>
 #include <unistd.h>
 #include <utime.h>
 
 using namespace llvm;
 
+#include "daemon.hpp"
 #include "objectcache.hpp"
+#include "stats.hpp"
+
+/// What is left to do for the object file of a module once the compiler has
+/// written it: restore it from the cache, or store it there.
+struct PendingOutput {
+  enum { FromCache, ToCache } mode = ToCache;
+  std::string objectfile;
+  std::string copy; // the cache entry, empty if irhashd chooses it for a store
+  std::string key;
+  bool compressed = false;
+  bool bitcode = false; // the object file must be LLVM bitcode, not a native object file
+  ObjectCache::Artifacts extras; // further files, the entry is a bundle if there are any
+  int entryfd = -1; // irhashd's descriptor of the entry on a hit
+  std::chrono::steady_clock::time_point lookup_start;
+  std::vector<std::string> aliases; // further keys the object file is stored under, see IRHASH_TWO_STAGE
+  bool second_stage = false; // a miss of the first stage which the second stage hasn't looked up yet
+};
+
+static std::mutex state_lock;            // guards the state below
+static StringMap<PendingOutput> outputs; // by object file, finished at exit or when their context is destroyed
+static StringSet<> prelink; // object files of rustc's codegen units in their ThinLTO pre-link pipeline
+static DaemonClient irhashd;
+static CacheStats stats;
+
+#ifdef VALIDATION
+static std::string hashfile;
+
+static uint64_t to_ns(std::chrono::steady_clock::time_point t) {
+  // steady_clock is CLOCK_MONOTONIC, like the start time from time.so
+  return std::chrono::nanoseconds(t.time_since_epoch()).count();
+}
 
-static enum {
-  ATEXIT_NOP,
-  ATEXIT_FROM_CACHE,
-  ATEXIT_TO_CACHE,
-} atexit_mode = ATEXIT_NOP;
+/// Append the time the compiler exits to the .llvmhash file.
+static void finish_hashfile() {
+  std::ofstream out(hashfile, std::ios::app);
+  out << "end " << to_ns(std::chrono::steady_clock::now()) << '\n';
+}
 
-static char const *objectfile;
-static char const *objectfile_copy;
+/// Write the key and timestamps of this compilation to \p path, for the
+/// evaluation. The start of the process is only known if time.so is preloaded.
+static void write_hashfile(const std::string &path, StringRef key, bool found,
+                           std::chrono::steady_clock::time_point hash_start,
+                           std::chrono::steady_clock::time_point hash_end) {
+  uint64_t start = 0;
+  if (const struct timespec *ts = (const struct timespec *)dlsym(RTLD_DEFAULT, "irhash_start_time")) {
+    start = ts->tv_sec * 1000000000ull + ts->tv_nsec;
+  }
 
-/// This is the main entry point for the IRHash pass.
-PreservedAnalyses IRHashPass::run(Module &M, ModuleAnalysisManager &AM) {
-  this->M = &M;
-  this->MST = new ModuleSlotTracker(&M, true);
-  this->SlotTable = MST->getMachine();
+  hashfile = path;
+  std::ofstream out(hashfile);
+  out << "key " << key.str() << '\n';
+  out << "found " << found << '\n';
+  out << "start " << start << '\n';
+  out << "hash_start " << to_ns(hash_start) << '\n';
+  out << "hash_end " << to_ns(hash_end) << '\n';
+  atexit(finish_hashfile);
+}
+#endif
+
+/// Bundle the files \p artifacts of \p output into the new file \p bundle if
+/// there are further files besides the object file, otherwise \p bundle
+/// stays empty.
+static bool bundle_outputs(const PendingOutput &output, const ObjectCache::Artifacts &artifacts, std::string &bundle) {
+  if (output.extras.empty()) {
+    return true;
+  }
+  bundle = ObjectCache::tmp_name((output.objectfile + ".bundle").c_str());
+  unlink(bundle.c_str());
+  struct stat st;
+  if (!ObjectCache::write_bundle(artifacts, bundle.c_str()) || stat(bundle.c_str(), &st) != 0) {
+    errs() << "irhash: can't bundle the outputs of " << output.objectfile << '\n';
+    unlink(bundle.c_str());
+    bundle.clear();
+    return false;
+  }
+  return true;
+}
+
+/// Store \p src as the cache entry of \p key, through irhashd if it is
+/// connected. \p entry is the path of the entry, chosen here if it is empty.
+static bool store_entry(const std::string &key, std::string &entry, const char *src, const std::string &objectfile,
+                        bool async) {
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (irhashd.connected() && irhashd.store(key, src)) {
+      return true;
+    }
+  }
+  // Stores may finish in the background after the compiler has exited
+  ObjectCache cache(getenv("IRHASH_CACHE"));
+  if (entry.empty()) {
+    char *path = cache.objectcopy_filename(objectfile, key);
+    entry = path;
+    free(path);
+  }
+  return cache.store(src, entry.c_str(), async);
+}
 
-  Hasher &hash = this->ModuleHash;
+/// Restore or store the object file of a module.
+static void finish_output(PendingOutput &output, bool async) {
+  const bool store = output.mode == PendingOutput::ToCache;
+  const char *src = store ? output.objectfile.c_str() : output.copy.c_str();
 
-  // The actual hashing of the module
+  const auto start = std::chrono::steady_clock::now();
+  if (output.second_stage) {
+    // The second stage, which counts the misses it sees, didn't run
+    stats.add(CacheStats::Misses);
+  }
+  if (store) {
+    // The rest of the compilation, which a hit would have saved
+    stats.add(CacheStats::MissNanos, std::chrono::nanoseconds(start - output.lookup_start).count());
+  }
 
-  hash.update(M.getModuleInlineAsm());
+  struct stat srcst;
+  if (stat(src, &srcst) != 0) { // src exists
+    errs() << "src=" << src << '\n';
+    perror("irhash: source objectfile/objectfile copy does not exist");
+    stats.add(store ? CacheStats::StoreFailures : CacheStats::RestoreFailures);
+    return;
+  }
 
-  hash.update(M.getTargetTriple());
+  // Bitcode and native object files must never end up under the same key
+  file_magic magic;
+  if (store && !identify_magic(src, magic) && (magic == file_magic::bitcode) != output.bitcode) {
+    errs() << "irhash: " << src << " is " << (output.bitcode ? "not" : "unexpectedly") << " LLVM bitcode, not caching\n";
+    stats.add(CacheStats::StoreFailures);
+    return;
+  }
 
-  for (const StructType *T : M.getIdentifiedStructTypes()) {
-    hash.update(T->isLiteral());
-    hash.update(T->isOpaque());
-    hash.update(T->isPacked());
+  ObjectCache::Artifacts artifacts{{"object", output.objectfile}};
+  artifacts.insert(artifacts.end(), output.extras.begin(), output.extras.end());
+  std::string bundle;
+  if (store && !bundle_outputs(output, artifacts, bundle)) {
+    stats.add(CacheStats::StoreFailures);
+    return;
+  }
+  if (!bundle.empty()) {
+    src = bundle.c_str();
+    stat(src, &srcst);
+  }
 
-    for (Type *Ty : T->elements()) {
-      hashType(Ty, hash);
+  bool ok = false;
+  if (store) {
+    ok = store_entry(output.key, output.copy, src, output.objectfile, async);
+    for (const std::string &alias : output.aliases) {
+      std::string entry;
+      store_entry(alias, entry, src, output.objectfile, async);
+    }
+    if (!bundle.empty()) {
+      unlink(bundle.c_str());
     }
+  } else if (output.extras.empty()) {
+    ok = ObjectCache::restore(src, output.objectfile.c_str(), output.compressed);
+  } else {
+    ok = ObjectCache::restore_bundle(src, output.compressed, artifacts);
+  }
+  if (!ok) {
+    errs() << "src=" << src << " dst=" << (store ? output.copy : output.objectfile) << '\n';
+    perror("irhash: objectfile update failed");
+    stats.add(store ? CacheStats::StoreFailures : CacheStats::RestoreFailures);
+    return;
   }
 
-  for (const Function &F : M.functions()) {
-    IRHashPass::hashFunction(F, hash);
+  const auto end = std::chrono::steady_clock::now();
+  if (!store) {
+    // Update Timestamp, of the cache entry too if it was copied
+    utime(output.objectfile.c_str(), NULL);
+    utime(src, NULL);
+
+    struct stat dstst;
+    stats.add(CacheStats::BytesRestored, stat(output.objectfile.c_str(), &dstst) == 0 ? dstst.st_size : srcst.st_size);
+    stats.add(CacheStats::HitNanos, std::chrono::nanoseconds(end - output.lookup_start).count());
+
+    // The restored files are the entry of the other keys, too
+    if (!output.aliases.empty() && bundle_outputs(output, artifacts, bundle)) {
+      const char *restored = bundle.empty() ? output.objectfile.c_str() : bundle.c_str();
+      for (const std::string &alias : output.aliases) {
+        std::string entry;
+        store_entry(alias, entry, restored, output.objectfile, async);
+      }
+      if (!bundle.empty()) {
+        unlink(bundle.c_str());
+      }
+    }
+  } else {
+    stats.add(CacheStats::Stores);
+    stats.add(CacheStats::BytesStored, srcst.st_size);
+    stats.add(CacheStats::StoreNanos, std::chrono::nanoseconds(end - start).count());
   }
+}
 
-  for (const GlobalVariable &GV : M.globals()) {
-    IRHashPass::hashGlobalVariable(GV, hash);
+/// Finish the recorded output of \p objectfile, if it is still pending.
+static void finish_recorded(StringRef objectfile, bool async) {
+  PendingOutput output;
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    auto it = outputs.find(objectfile);
+    if (it == outputs.end()) {
+      return;
+    }
+    output = std::move(it->second);
+    outputs.erase(it);
+  }
+  finish_output(output, async);
+  if (output.entryfd >= 0) {
+    close(output.entryfd);
   }
+}
 
-  Hasher::Digest digest;
-  this->ModuleHash.final(digest);
+static void finish_outputs_at_exit() {
+  std::vector<std::string> objectfiles;
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    for (const auto &entry : outputs) {
+      objectfiles.push_back(entry.getKey().str());
+    }
+  }
+  for (const std::string &objectfile : objectfiles) {
+    finish_recorded(objectfile, getenv("IRHASH_ASYNC_STORE"));
+  }
+}
 
-  auto hash_str = digest.digest();
+/// Finishes the recorded output of a module once the LLVMContext of the
+/// module is destroyed, which compilers that consume the object file before
+/// they exit do right after writing it (rustc has a context per codegen unit).
+/// The handle is on a constant of the context which no module uses, so the
+/// IR and the object file stay as they are.
+class OutputSentinel final : public CallbackVH {
+  std::string objectfile;
+
+  void deleted() override {
+    // Other modules are still compiled, don't fork
+    finish_recorded(objectfile, false);
+    delete this;
+  }
 
-  const std::string out_file = getOutFile();
+public:
+  OutputSentinel(Value *V, std::string objectfile) : CallbackVH(V), objectfile(std::move(objectfile)) {}
+};
+
+/// Record \p output, which replaces an earlier output of the same file. It
+/// is finished when the compiler exits or, with \p context, when that
+/// context is destroyed, whichever comes first.
+static void record_output(PendingOutput output, LLVMContext *context) {
+  const std::string objectfile(output.objectfile);
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    static std::once_flag registered;
+    std::call_once(registered, [] { atexit(finish_outputs_at_exit); });
+    auto [it, inserted] = outputs.try_emplace(objectfile);
+    if (!inserted && it->second.entryfd >= 0) {
+      close(it->second.entryfd);
+    }
+    it->second = std::move(output);
+  }
+  if (context) {
+    new OutputSentinel(ConstantDataArray::getString(*context, "irhash " + objectfile), objectfile);
+  }
+}
+
+/// Remove everything from \p M, its object file is replaced by the cache
+/// entry anyway. The compiler just writes an empty one.
+static void strip_module(Module &M) {
+  // References between globals are dropped first, so they can go in any order
+  for (Function &F : M) {
+    F.dropAllReferences();
+  }
+  for (GlobalVariable &GV : M.globals()) {
+    GV.dropAllReferences();
+  }
+  for (GlobalAlias &GA : M.aliases()) {
+    GA.dropAllReferences();
+  }
+  for (GlobalIFunc &GI : M.ifuncs()) {
+    GI.dropAllReferences();
+  }
+  for (Function &F : make_early_inc_range(M)) {
+    F.eraseFromParent();
+  }
+  for (GlobalVariable &GV : make_early_inc_range(M.globals())) {
+    GV.eraseFromParent();
+  }
+  for (GlobalAlias &GA : make_early_inc_range(M.aliases())) {
+    GA.eraseFromParent();
+  }
+  for (GlobalIFunc &GI : make_early_inc_range(M.ifuncs())) {
+    GI.eraseFromParent();
+  }
+  M.setModuleInlineAsm("");
+  StripDebugInfo(M);
+}
+
+/// This is the main entry point for the IRHash pass.
+PreservedAnalyses IRHashPass::run(Module &M, ModuleAnalysisManager &AM) {
+  if (stage == Stage::Second) {
+    return runSecondStage(M, configuration());
+  }
+
+  const ModuleOutput output = getOutput(M);
+  if (output.objectfile.empty()) {
+#ifdef DEBUG_LOGGING
+    errs() << '[' << M.getModuleIdentifier() << "] Output can't be cached\n";
+#endif
+    return PreservedAnalyses::all();
+  }
+  const std::string &out_file = output.objectfile;
+
+  // Codegen units linked within the crate pass the pipeline start only before
+  // the link, the early simplification both before and after it. Only the
+  // module the ThinLTO backend compiles is cached.
+  if (output.post_link != (stage == Stage::PostLink)) {
+#if PIPELINE == 0
+    if (output.post_link) {
+      std::lock_guard<std::mutex> guard(state_lock);
+      prelink.insert(out_file);
+    }
+#endif
+    return PreservedAnalyses::all();
+  }
+  if (stage == Stage::PostLink) {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (prelink.erase(out_file)) {
+      return PreservedAnalyses::all();
+    }
+  }
+
+  const auto hash_start = std::chrono::steady_clock::now();
+  const std::string config = configuration();
+  const Hasher::Digest digest =
+      withConfiguration(withKind(hashModule(M, getThreadCount(), HashOptions::fromEnv()), output.kind), config);
+  const auto lookup_start = std::chrono::steady_clock::now();
+
+  auto hash_str = digest.digest();
 
 #ifdef DEBUG
   std::string str;
@@ -82,37 +387,427 @@ PreservedAnalyses IRHashPass::run(Module &M, ModuleAnalysisManager &AM) {
   if (!cachedir) {
     llvm::report_fatal_error("IRHASH_CACHE not set");
   }
-  ObjectCache cache(cachedir);
 
-  objectfile = strdup(out_file.c_str());
+  openStats(cachedir);
+  stats.add(CacheStats::HashNanos, std::chrono::nanoseconds(lookup_start - hash_start).count());
+
+  PendingOutput pending;
+  pending.objectfile = out_file;
+  pending.key = hash_str.str().str();
+  pending.bitcode = output.bitcode;
+  pending.extras = output.extras;
+  pending.lookup_start = lookup_start;
+  if (!lookup(cachedir, pending)) {
+    return PreservedAnalyses::all();
+  }
+  const bool hit = pending.mode == PendingOutput::FromCache;
+#ifdef WITH_CLANG_PLUGIN
+  direct_mode_record(hash_str);
+#endif
+
+#ifdef VALIDATION
+  // Keep compiling even if the key is known, to time the whole compilation
+  write_hashfile(out_file + '.' + this->pass + ".llvmhash", hash_str, hit, hash_start, lookup_start);
+  if (hit) {
+    stats.add(CacheStats::Hits);
+    return PreservedAnalyses::all();
+  }
+#endif
 
-  std::string copy = cache.find_object_from_hash(out_file, hash_str.c_str());
-  atexit(link_object_file);
-  if (copy != "") { // hash is known
 #ifdef DEBUG_LOGGING
-    errs() << '[' << out_file << "] Found in cache: " << hash_str << '\n';
+  errs() << '[' << out_file << "] " << (hit ? "Found in cache: " : "Not found in cache: ") << hash_str
+         << (output.kind.empty() ? "" : " (" + output.kind + ")") << " in " << config << '\n';
 #endif
 
-    atexit_mode = ATEXIT_FROM_CACHE;
-    objectfile_copy = strdup(copy.c_str());
+  if (!hit && stage == Stage::First) {
+    // Finished like any other miss, unless the second stage finds the optimized module
+    pending.second_stage = true;
+    return finishModule(M, output.mode, pending);
+  }
+
+  stats.add(hit ? CacheStats::Hits : CacheStats::Misses);
+  return finishModule(M, output.mode, pending);
+}
+
+/// Second stage of IRHASH_TWO_STAGE, after the optimizer: look up the
+/// optimized module if the first stage missed. Edits which optimize away,
+/// e.g. in dead code, still hit and skip the backend. Either way, the object
+/// file is stored under the keys of both stages. The miss is already recorded
+/// by its object file: a hit replaces the record, a miss adds its key to it.
+PreservedAnalyses IRHashPass::runSecondStage(Module &M, StringRef configuration) {
+  const ModuleOutput output = getOutput(M);
+  PendingOutput first;
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    auto it = outputs.find(output.objectfile);
+    if (output.objectfile.empty() || it == outputs.end() || !it->second.second_stage) {
+      return PreservedAnalyses::all();
+    }
+    it->second.second_stage = false;
+    first = it->second;
+  }
+
+  // The optimized module is compiled differently than the same IR before optimization
+  const auto hash_start = std::chrono::steady_clock::now();
+  const std::string kind = output.kind.empty() ? "optimized" : output.kind + ",optimized";
+  const Hasher::Digest digest =
+      withConfiguration(withKind(hashModule(M, getThreadCount(), HashOptions::fromEnv()), kind), configuration);
+  const auto lookup_start = std::chrono::steady_clock::now();
+  stats.add(CacheStats::HashNanos, std::chrono::nanoseconds(lookup_start - hash_start).count());
+
+  PendingOutput pending;
+  pending.objectfile = first.objectfile;
+  pending.key = digest.digest().str().str();
+  pending.bitcode = first.bitcode;
+  pending.extras = first.extras;
+  pending.lookup_start = lookup_start;
+  if (!lookup(getenv("IRHASH_CACHE"), pending)) {
+    stats.add(CacheStats::Misses);
+    return PreservedAnalyses::all();
+  }
+  const bool hit = pending.mode == PendingOutput::FromCache;
+
+#ifdef DEBUG_LOGGING
+  errs() << '[' << first.objectfile << "] " << (hit ? "Found in cache" : "Not found in cache")
+         << " after optimization: " << pending.key << " (" << kind << ")\n";
+#endif
+#ifdef VALIDATION
+  if (hit) {
+    stats.add(CacheStats::Hits);
+    stats.add(CacheStats::OptimizedHits);
+    return PreservedAnalyses::all();
+  }
+#endif
+
+  if (hit) {
+    pending.aliases.push_back(first.key);
+    stats.add(CacheStats::Hits);
+    stats.add(CacheStats::OptimizedHits);
+    return finishModule(M, output.mode, pending);
+  }
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    auto it = outputs.find(first.objectfile);
+    if (it != outputs.end()) {
+      it->second.aliases.push_back(pending.key);
+    }
+  }
+  stats.add(CacheStats::Misses);
+  return PreservedAnalyses::all();
+}
+
+/// Restore (\p pending is a hit) or store the object file of \p M once the
+/// compiler has written it, as \p mode says.
+PreservedAnalyses IRHashPass::finishModule(Module &M, HitMode mode, PendingOutput &pending) {
+  const bool hit = pending.mode == PendingOutput::FromCache;
+
+  // The object file of the last build may be a hardlink to a cache entry,
+  // which a compiler that writes the file in place would overwrite
+  unlink(pending.objectfile.c_str());
+
+  if (mode == HitMode::Exit) {
+    record_output(std::move(pending), nullptr);
+    if (hit) {
 #ifdef WITH_CLANG_PLUGIN
-    CLANG_CI->getPreprocessor().EndSourceFile();
+      if (CLANG_CI) {
+        CLANG_CI->getPreprocessor().EndSourceFile();
+      }
 #endif
-    exit(0);
-  } else {
+      exit(0);
+    }
+    // continue compilation
+    return PreservedAnalyses::all();
+  }
+
+  // The compiler goes on with other modules. On a hit, it writes an empty
+  // object file for this one, which is replaced by the cache entry later.
+  if (hit) {
+    strip_module(M);
+  }
+  record_output(std::move(pending), mode == HitMode::OnDestroy ? &M.getContext() : nullptr);
+  return PreservedAnalyses::none();
+}
+
+void IRHashPass::openStats(const char *cachedir) {
+  std::lock_guard<std::mutex> guard(state_lock);
+  stats.open(cachedir);
+}
+
+/// Look up the key of \p output in irhashd or, if it isn't running, the
+/// cache directory. Returns false if the cache can't be used. On a hit,
+/// \p output is turned into a restore of the entry.
+bool IRHashPass::lookup(const char *cachedir, PendingOutput &output) {
+  DaemonClient::Reply reply = DaemonClient::Error;
+  std::string suffix;
+  if (const char *socket = getenv("IRHASH_DAEMON")) {
+    // Modules may be compiled in parallel, requests and replies must not interleave
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (irhashd.connected() || irhashd.connect(socket)) {
+      reply = irhashd.lookup(Hasher::Algorithm, output.key, output.entryfd, suffix);
+    }
+    if (reply == DaemonClient::Error && irhashd.connected()) {
+      irhashd.disconnect();
+    }
+  }
+
+  ObjectCache cache(cachedir);
+  if (reply == DaemonClient::Mismatch ||
+      (reply == DaemonClient::Error && !cache.check_algorithm(Hasher::Algorithm))) {
+    errs() << "irhash: " << cachedir << " holds keys of a different hash algorithm than " << Hasher::Algorithm
+           << ", not caching\n";
+    return false;
+  }
+
+  std::string copy;
+  if (reply == DaemonClient::Hit) {
+    // The entry stays readable through the descriptor even if it is evicted
+    copy = "/proc/self/fd/" + std::to_string(output.entryfd);
+    output.compressed = ObjectCache::is_compressed(suffix);
+  } else if (reply == DaemonClient::Error) {
+    copy = cache.find_object_from_hash(output.objectfile, output.key);
+    output.compressed = ObjectCache::is_compressed(copy);
+  }
+  if (copy != "") {
+    output.mode = PendingOutput::FromCache;
+    output.copy = copy;
+  } else if (reply == DaemonClient::Error) {
+    // A miss without irhashd, which would choose the entry itself
+    char *entry = cache.objectcopy_filename(output.objectfile, output.key);
+    output.copy = entry;
+    free(entry);
+  }
+  return true;
+}
+
+bool IRHashPass::lookupDirect(const std::string &key, std::chrono::steady_clock::time_point check_start) {
+  const char *cachedir = getenv("IRHASH_CACHE");
+  const auto lookup_start = std::chrono::steady_clock::now();
+  openStats(cachedir);
+  // Checking the manifest replaces hashing the IR
+  stats.add(CacheStats::HashNanos, std::chrono::nanoseconds(lookup_start - check_start).count());
+
+  const ModuleOutput output = getClangOutput();
+  if (output.objectfile.empty()) {
+    return false;
+  }
+  PendingOutput pending;
+  pending.objectfile = output.objectfile;
+  pending.extras = output.extras;
+  pending.key = key;
+  pending.lookup_start = lookup_start;
+  if (!lookup(cachedir, pending) || pending.mode != PendingOutput::FromCache) {
+    return false;
+  }
 #ifdef DEBUG_LOGGING
-    errs() << '[' << out_file << "] Not found in cache: " << hash_str << '\n';
+  errs() << '[' << pending.objectfile << "] Found in cache by manifest: " << key << '\n';
 #endif
 
-    atexit_mode = ATEXIT_TO_CACHE;
-    objectfile_copy = cache.objectcopy_filename(objectfile, hash_str.c_str());
-    // continue compilation
+  record_output(std::move(pending), nullptr);
+  stats.add(CacheStats::Hits);
+  stats.add(CacheStats::DirectHits);
+  return true;
+}
+
+Hasher::Digest IRHashPass::withKind(const Hasher::Digest &IR, StringRef kind) {
+  if (kind.empty()) {
+    return IR;
   }
+  Hasher hash;
+  hash.update(IR);
+  hash.update(kind);
+  Hasher::Digest digest;
+  hash.final(digest);
+  return digest;
+}
 
-  return PreservedAnalyses::all();
+Hasher::Digest IRHashPass::withConfiguration(const Hasher::Digest &key, StringRef configuration) {
+  Hasher hash;
+  hash.update(key);
+  hash.update(configuration);
+  Hasher::Digest digest;
+  hash.final(digest);
+  return digest;
+}
+
+/// Kind and name of the symbol \p GO defines or declares.
+static Symbol symbol_of(const GlobalObject *GO) { return {isa<Function>(GO) ? "function" : "global", GO->getName()}; }
+
+void IRHashPass::collectLive(const Module &M, SmallPtrSetImpl<const GlobalValue *> &Live) {
+  SmallPtrSet<const Constant *, 32> Visited;
+  SmallVector<const User *, 64> Worklist;
+  auto reach = [&](const Value *V) {
+    if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+      if (Live.insert(GV).second) {
+        Worklist.push_back(GV);
+      }
+    } else if (const Constant *C = dyn_cast<Constant>(V)) {
+      if (Visited.insert(C).second) {
+        Worklist.push_back(C);
+      }
+    }
+  };
+
+  // Appending globals like llvm.used and llvm.global_ctors are roots as well
+  for (const GlobalValue &GV : M.global_values()) {
+    if (!GV.isDeclaration() && !GV.hasLocalLinkage() && !GV.hasAvailableExternallyLinkage()) {
+      reach(&GV);
+    }
+  }
+
+  // Operands are initializers, aliasees, resolvers and the personality, prefix
+  // and prologue of functions
+  while (!Worklist.empty()) {
+    const User *U = Worklist.pop_back_val();
+    for (const Value *op : U->operands()) {
+      reach(op);
+    }
+    if (const Function *F = dyn_cast<Function>(U)) {
+      for (const BasicBlock &BB : *F) {
+        for (const Instruction &I : BB) {
+          for (const Value *op : I.operands()) {
+            reach(op);
+          }
+        }
+      }
+    }
+  }
 }
 
-void IRHashPass::hashGlobalVariable(const GlobalVariable &GV, Hasher &hash) {
+/// Add the identified struct types nested in those of \p Structs.
+static void collect_nested_structs(SmallPtrSetImpl<const StructType *> &Structs) {
+  SmallVector<const Type *, 16> Worklist(Structs.begin(), Structs.end());
+  while (!Worklist.empty()) {
+    for (const Type *Ty : Worklist.pop_back_val()->subtypes()) {
+      const StructType *STy = dyn_cast<StructType>(Ty);
+      if (!STy || STy->isLiteral()) {
+        Worklist.push_back(Ty);
+      } else if (Structs.insert(STy).second) {
+        Worklist.push_back(STy);
+      }
+    }
+  }
+}
+
+Hasher::Digest IRHashPass::hashModule(const Module &M, unsigned Threads, const HashOptions &Options) {
+  Hasher hash;
+  HashContext Ctx;
+
+  hash.update(KeyVersion);
+
+  // Every function and global gets its own digest.
+  // They are independent of each other, so the workers just pull the next
+  // unhashed entity until all are done.
+  std::vector<const GlobalObject *> Entities;
+  for (const Function &F : M.functions()) {
+    Entities.push_back(&F);
+  }
+  for (const GlobalVariable &GV : M.globals()) {
+    Entities.push_back(&GV);
+  }
+  if (Options.Prune) {
+    hash.update(StringRef("prune"));
+    SmallPtrSet<const GlobalValue *, 32> Live;
+    collectLive(M, Live);
+    llvm::erase_if(Entities, [&](const GlobalObject *GO) { return !Live.count(GO); });
+  }
+  if (Options.Unordered) {
+    // Unnamed entities keep their module order among each other
+    hash.update(StringRef("unordered"));
+    std::stable_sort(Entities.begin(), Entities.end(), [](const GlobalObject *lhs, const GlobalObject *rhs) {
+      return symbol_of(lhs) < symbol_of(rhs);
+    });
+  }
+
+  MetadataSlots MD;
+  if (Options.DebugInfo) {
+    hash.update(StringRef("debuginfo"));
+    collectMetadata(M, Entities, MD);
+    Ctx.MD = &MD;
+    hashMetadataNodes(M, Ctx, hash);
+  }
+  if (Options.Canonical) {
+    hash.update(StringRef("canonical"));
+    Ctx.Canonical = true;
+  }
+  Ctx.Prune = Options.Prune;
+
+  hash.update(M.getModuleInlineAsm());
+
+  hash.update(M.getTargetTriple());
+
+  std::vector<StructType *> Structs = M.getIdentifiedStructTypes();
+  if (Options.Unordered) {
+    // Their order is the order in which the module uses them first
+    std::stable_sort(Structs.begin(), Structs.end(),
+                     [](const StructType *lhs, const StructType *rhs) { return lhs->getName() < rhs->getName(); });
+  }
+  auto hashStructs = [&]() {
+    for (const StructType *T : Structs) {
+      hash.update(T->isLiteral());
+      hash.update(T->isOpaque());
+      hash.update(T->isPacked());
+
+      for (Type *Ty : T->elements()) {
+        hashType(Ty, Ctx, hash);
+      }
+    }
+  };
+  if (!Options.Prune) {
+    hashStructs();
+  }
+
+  const size_t N = Entities.size();
+  std::vector<Hasher::Digest> Digests(N);
+  std::atomic<size_t> Next{0};
+
+  auto worker = [&](HashContext &Ctx) {
+    Hasher entity;
+    for (size_t i = Next++; i < N; i = Next++) {
+      entity.reset();
+      if (const Function *F = dyn_cast<Function>(Entities[i])) {
+        hashFunction(*F, Ctx, entity);
+      } else {
+        hashGlobalVariable(*cast<GlobalVariable>(Entities[i]), Ctx, entity);
+      }
+      entity.final(Digests[i]);
+    }
+  };
+
+  std::vector<HashContext> WorkerCtxs(std::max<size_t>(std::min<size_t>(Threads, N), 1) - 1);
+  std::vector<std::thread> Workers;
+  for (HashContext &WorkerCtx : WorkerCtxs) {
+    WorkerCtx.MD = Ctx.MD;
+    WorkerCtx.Canonical = Ctx.Canonical;
+    WorkerCtx.Prune = Ctx.Prune;
+    Workers.emplace_back([&]() { worker(WorkerCtx); });
+  }
+  worker(Ctx);
+  for (std::thread &T : Workers) {
+    T.join();
+  }
+
+  // Combine in the order of the entities, independent of which worker hashed what
+  for (const Hasher::Digest &D : Digests) {
+    hash.update(D);
+  }
+
+  if (Options.Prune) {
+    // Only the struct types which the hashed entities use, directly or
+    // nested in other types, once all of them are known
+    for (const HashContext &WorkerCtx : WorkerCtxs) {
+      Ctx.Structs.insert(WorkerCtx.Structs.begin(), WorkerCtx.Structs.end());
+    }
+    collect_nested_structs(Ctx.Structs);
+    llvm::erase_if(Structs, [&](const StructType *T) { return !Ctx.Structs.count(T); });
+    hashStructs();
+  }
+
+  Hasher::Digest digest;
+  hash.final(digest);
+  return digest;
+}
+
+void IRHashPass::hashGlobalVariable(const GlobalVariable &GV, HashContext &Ctx, Hasher &hash) {
   hash.update(GV.getName());
 
   hash.update(GV.getLinkage());
@@ -125,20 +820,25 @@ void IRHashPass::hashGlobalVariable(const GlobalVariable &GV, Hasher &hash) {
   hash.update(hasInit);
   if (hasInit) {
     const Constant *CV = static_cast<const Constant *>(GV.getInitializer());
-    hashValue(CV, hash);
+    hashValue(CV, Ctx, hash);
   }
 
-  hashType(GV.getValueType(), hash);
+  hashType(GV.getValueType(), Ctx, hash);
   hash.update(GV.getThreadLocalMode());
   hash.update((int)GV.getUnnamedAddr());
 
-  for (auto attr : GV.getAttributes()) {
-    hash.update(attr.getKindAsEnum());
+  hashAttributes(GV.getAttributes(), Ctx, hash);
+
+  if (Ctx.MD) {
+    SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+    GV.getAllMetadata(MDs);
+    hashAttachments(MDs, Ctx, hash);
   }
 }
 
-void IRHashPass::hashFunction(const Function &F, Hasher &hash) {
-  SlotTable->incorporateFunction(&F);
+void IRHashPass::hashFunction(const Function &F, HashContext &Ctx, Hasher &hash) {
+  LocalSlots &Slots = Ctx.Slots;
+  Slots.reset();
 
   hash.update(F.getName());
   hash.update(F.isDeclaration());
@@ -149,29 +849,48 @@ void IRHashPass::hashFunction(const Function &F, Hasher &hash) {
     hash.update(A->value());
   }
 
-  hashType(F.getReturnType(), hash);
+  hashType(F.getReturnType(), Ctx, hash);
   for (Type *Ty : F.getFunctionType()->params()) {
-    hashType(Ty, hash);
+    hashType(Ty, Ctx, hash);
   }
   hash.update(F.isVarArg());
 
-  for (const AttributeSet attrSet : F.getAttributes()) {
-    for (const Attribute attr : attrSet) {
-      hash.update(attr.getKindAsEnum());
-    }
+  hashAttributes(F.getAttributes(), Ctx, hash);
+
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  if (Ctx.MD) {
+    F.getAllMetadata(MDs);
+    hashAttachments(MDs, Ctx, hash);
   }
 
   for (const BasicBlock &BB : F) {
-    if (BB.hasName()) {
+    if (BB.hasName() && !Ctx.Canonical) {
       hash.update(BB.getName());
     }
+    // Branches refer to blocks by slot, so the block needs one even if it is named
+    hash.update(Slots.get(&BB));
     for (const Instruction &I : BB) {
+      if (Ctx.MD) {
+        hashDebugRecords(I, Ctx, hash);
+      }
       hash.update(I.getOpcode());
+      hashType(I.getType(), Ctx, hash);
+      // nsw, nuw, exact, inbounds and the fast-math flags
+      hash.update(I.getRawSubclassOptionalData());
 
-      if (I.hasName()) {
+      if (I.hasName() && !Ctx.Canonical) {
         hash.update(I.getName());
       } else if (!I.getType()->isVoidTy()) {
-        hash.update(SlotTable->getLocalSlot(&I));
+        hash.update(Slots.get(&I));
+      }
+
+      if (const CallBase *CB = dyn_cast<CallBase>(&I)) {
+        hashType(CB->getFunctionType(), Ctx, hash);
+        hash.update(CB->getCallingConv());
+        hashAttributes(CB->getAttributes(), Ctx, hash);
+      }
+      if (const GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+        hashType(GEP->getSourceElementType(), Ctx, hash);
       }
 
       if (const CallInst *CI = dyn_cast<CallInst>(&I)) {
@@ -179,10 +898,43 @@ void IRHashPass::hashFunction(const Function &F, Hasher &hash) {
       } else if (const CmpInst *CI = dyn_cast<CmpInst>(&I)) {
         hash.update(CI->getPredicate());
       } else if (const AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
-        hashType(AI->getAllocatedType(), hash);
-        hashType(AI->getArraySize()->getType(), hash);
+        hashType(AI->getAllocatedType(), Ctx, hash);
+        hashType(AI->getArraySize()->getType(), Ctx, hash);
         hash.update(AI->getAlign().value());
       } else {
+        if (const LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+          hash.update(LI->getAlign().value());
+          hash.update((uint64_t)LI->getOrdering());
+          hash.update(LI->getSyncScopeID());
+        } else if (const StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          hash.update(SI->getAlign().value());
+          hash.update((uint64_t)SI->getOrdering());
+          hash.update(SI->getSyncScopeID());
+        } else if (const AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+          hash.update(RMW->getOperation());
+          hash.update((uint64_t)RMW->getOrdering());
+          hash.update(RMW->getSyncScopeID());
+        } else if (const AtomicCmpXchgInst *CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+          hash.update((uint64_t)CX->getSuccessOrdering());
+          hash.update((uint64_t)CX->getFailureOrdering());
+          hash.update(CX->getSyncScopeID());
+        } else if (const FenceInst *FI = dyn_cast<FenceInst>(&I)) {
+          hash.update((uint64_t)FI->getOrdering());
+          hash.update(FI->getSyncScopeID());
+        } else if (const ExtractValueInst *EV = dyn_cast<ExtractValueInst>(&I)) {
+          // Indices and masks which aren't operands
+          for (unsigned Idx : EV->indices()) {
+            hash.update(Idx);
+          }
+        } else if (const InsertValueInst *IV = dyn_cast<InsertValueInst>(&I)) {
+          for (unsigned Idx : IV->indices()) {
+            hash.update(Idx);
+          }
+        } else if (const ShuffleVectorInst *SV = dyn_cast<ShuffleVectorInst>(&I)) {
+          for (int Elt : SV->getShuffleMask()) {
+            hash.update(Elt);
+          }
+        }
         hash.update((isa<LoadInst>(I) && cast<LoadInst>(I).isAtomic()) ||
                     (isa<StoreInst>(I) && cast<StoreInst>(I).isAtomic()));
 
@@ -196,12 +948,14 @@ void IRHashPass::hashFunction(const Function &F, Hasher &hash) {
 
       for (unsigned i = 0, E = I.getNumOperands(); i != E; ++i) {
         const Value *op = I.getOperand(i);
+        // Otherwise e.g. argument 0 and the constant 0.0 could hash the same
+        hash.update(op->getValueID());
         if (const Instruction *II = dyn_cast<Instruction>(op)) {
-          if (II->hasName()) {
+          if (II->hasName() && !Ctx.Canonical) {
             hash.update(II->getName());
           } else if (!II->getType()->isVoidTy()) {
             // TODO !isVoidTy should be unneccesary - we're using the instruction's result as operand
-            hash.update(SlotTable->getLocalSlot(II));
+            hash.update(Slots.get(II));
           }
         } else if (const Constant *C = dyn_cast<Constant>(op)) {
           const GlobalVariable *GV = dyn_cast<GlobalVariable>(C);
@@ -209,66 +963,391 @@ void IRHashPass::hashFunction(const Function &F, Hasher &hash) {
             // for global vars, we only need to hash their reference
             hash.update(GV->getName());
           } else {
-            hashValue(C, hash);
+            hashValue(C, Ctx, hash);
           }
         } else if (const BasicBlock *BB = dyn_cast<BasicBlock>(op)) {
-          hash.update(SlotTable->getLocalSlot(BB));
+          hash.update(Slots.get(BB));
         } else if (const Argument *Arg = dyn_cast<Argument>(op)) {
-          hashType(Arg->getType(), hash);
-          if (Arg->hasName()) {
+          hashType(Arg->getType(), Ctx, hash);
+          if (Arg->hasName() && !Ctx.Canonical) {
             hash.update(Arg->getName());
           } else {
-            hash.update(SlotTable->getLocalSlot(Arg));
+            hash.update(Arg->getArgNo());
           }
         } else if (const InlineAsm *IA = dyn_cast<InlineAsm>(op)) {
           hash.update(IA->canThrow());
           hash.update(IA->isAlignStack());
           hash.update(IA->getAsmString());
           hash.update(IA->getConstraintString());
-        } else if (isa<MetadataAsValue>(op)) {
-          // Ignore for now
-          break;
+        } else if (const MetadataAsValue *MAV = dyn_cast<MetadataAsValue>(op)) {
+          if (!Ctx.MD) {
+            // Without IRHASH_DEBUGINFO, metadata operands (and the rest of the operands) are ignored
+            break;
+          }
+          hashMetadata(MAV->getMetadata(), Ctx, hash);
         } else {
           errs() << I << '\n';
           errs() << *op << '\n';
           llvm_unreachable("Unhandled Instruction");
         }
       }
+
+      // The incoming blocks of a PHI aren't operands
+      if (const PHINode *PN = dyn_cast<PHINode>(&I)) {
+        for (const BasicBlock *BB : PN->blocks()) {
+          hash.update(Slots.get(BB));
+        }
+      }
+
+      // Including the debug location
+      if (Ctx.MD) {
+        I.getAllMetadata(MDs);
+        hashAttachments(MDs, Ctx, hash);
+      }
+    }
+  }
+}
+
+void IRHashPass::MetadataSlots::add(const Metadata *MD) {
+  // The arguments of a DIArgList are local values, they are hashed where it is used
+  const MDNode *N = dyn_cast_or_null<MDNode>(MD);
+  if (!N || isa<DIArgList>(MD) || !Map.try_emplace(N, Nodes.size()).second) {
+    return;
+  }
+  Nodes.push_back(N);
+
+  // Debug info is deeply nested, so the operands are numbered without recursion
+  SmallVector<const MDNode *, 16> Worklist{N};
+  while (!Worklist.empty()) {
+    const MDNode *Node = Worklist.pop_back_val();
+    for (const MDOperand &Op : Node->operands()) {
+      const MDNode *Next = dyn_cast_or_null<MDNode>(Op.get());
+      if (Next && Map.try_emplace(Next, Nodes.size()).second) {
+        Nodes.push_back(Next);
+        Worklist.push_back(Next);
+      }
+    }
+  }
+}
+
+#if LLVM_VERSION_MAJOR >= 19
+/// The metadata of the debug record \p DR: its location, and its label or its
+/// variable, expression and value (and the assignment of dbg_assign).
+static void debug_record_operands(const DbgRecord &DR, SmallVectorImpl<const Metadata *> &Ops) {
+  Ops.clear();
+  Ops.push_back(DR.getDebugLoc().getAsMDNode());
+  if (const DbgLabelRecord *DLR = dyn_cast<DbgLabelRecord>(&DR)) {
+    Ops.push_back(DLR->getLabel());
+    return;
+  }
+  const DbgVariableRecord &DVR = cast<DbgVariableRecord>(DR);
+  Ops.push_back(DVR.getVariable());
+  Ops.push_back(DVR.getExpression());
+  Ops.push_back(DVR.getRawLocation());
+  if (DVR.isDbgAssign()) {
+    Ops.push_back(DVR.getRawAssignID());
+    Ops.push_back(DVR.getRawAddress());
+    Ops.push_back(DVR.getAddressExpression());
+  }
+}
+#endif
+
+/// Number all metadata nodes \p M refers to, in the order of \p Entities.
+void IRHashPass::collectMetadata(const Module &M, ArrayRef<const GlobalObject *> Entities, MetadataSlots &MD) {
+  M.getContext().getMDKindNames(MD.KindNames);
+
+  for (const NamedMDNode &NMD : M.named_metadata()) {
+    for (const MDNode *N : NMD.operands()) {
+      MD.add(N);
+    }
+  }
+
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+#if LLVM_VERSION_MAJOR >= 19
+  SmallVector<const Metadata *, 8> Ops;
+#endif
+  for (const GlobalObject *GO : Entities) {
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(GO)) {
+      MDs.clear();
+      GV->getAllMetadata(MDs);
+      for (const auto &[Kind, N] : MDs) {
+        MD.add(N);
+      }
+    }
+  }
+  for (const GlobalObject *GO : Entities) {
+    const Function *F = dyn_cast<Function>(GO);
+    if (!F) {
+      continue;
+    }
+    MDs.clear();
+    F->getAllMetadata(MDs);
+    for (const auto &[Kind, N] : MDs) {
+      MD.add(N);
+    }
+    for (const BasicBlock &BB : *F) {
+      for (const Instruction &I : BB) {
+        for (const Value *op : I.operands()) {
+          if (const MetadataAsValue *MAV = dyn_cast<MetadataAsValue>(op)) {
+            MD.add(MAV->getMetadata());
+          }
+        }
+        I.getAllMetadata(MDs);
+        for (const auto &[Kind, N] : MDs) {
+          MD.add(N);
+        }
+#if LLVM_VERSION_MAJOR >= 19
+        for (const DbgRecord &DR : I.getDbgRecordRange()) {
+          debug_record_operands(DR, Ops);
+          for (const Metadata *Op : Ops) {
+            MD.add(Op);
+          }
+        }
+#endif
+      }
+    }
+  }
+}
+
+/// Hash the fields of \p N which aren't operands, false if its class isn't
+/// handled here. The fields are those of LLVM 18, other versions print all
+/// nodes until they are checked.
+static bool hash_metadata_fields(const MDNode *N, Hasher &hash) {
+#if LLVM_VERSION_MAJOR <= 18
+  if (isa<MDTuple>(N)) {
+    return true;
+  } else if (const DILocation *L = dyn_cast<DILocation>(N)) {
+    hash.update(L->getLine());
+    hash.update(L->getColumn());
+    hash.update(L->isImplicitCode());
+    return true;
+  } else if (const DILocalVariable *V = dyn_cast<DILocalVariable>(N)) {
+    hash.update(V->getTag());
+    hash.update(V->getLine());
+    hash.update(V->getArg());
+    hash.update(V->getFlags());
+    hash.update(V->getAlignInBits());
+    return true;
+  } else if (const DILexicalBlock *B = dyn_cast<DILexicalBlock>(N)) {
+    hash.update(B->getTag());
+    hash.update(B->getLine());
+    hash.update(B->getColumn());
+    return true;
+  } else if (const DILexicalBlockFile *B = dyn_cast<DILexicalBlockFile>(N)) {
+    hash.update(B->getTag());
+    hash.update(B->getDiscriminator());
+    return true;
+  } else if (const DIExpression *E = dyn_cast<DIExpression>(N)) {
+    hash.update(E->getNumElements());
+    for (uint64_t Op : E->getElements()) {
+      hash.update(Op);
+    }
+    return true;
+  } else if (isa<DIGlobalVariableExpression>(N) || isa<DISubrange>(N)) {
+    return true;
+  } else if (const DISubprogram *SP = dyn_cast<DISubprogram>(N)) {
+    hash.update(SP->getTag());
+    hash.update(SP->getLine());
+    hash.update(SP->getScopeLine());
+    hash.update(SP->getVirtualIndex());
+    hash.update(SP->getThisAdjustment());
+    hash.update(SP->getFlags());
+    hash.update(SP->getSPFlags());
+    return true;
+  } else if (const DIGlobalVariable *GV = dyn_cast<DIGlobalVariable>(N)) {
+    hash.update(GV->getTag());
+    hash.update(GV->getLine());
+    hash.update(GV->isLocalToUnit());
+    hash.update(GV->isDefinition());
+    hash.update(GV->getAlignInBits());
+    return true;
+  } else if (const DIFile *F = dyn_cast<DIFile>(N)) {
+    // The checksum and the source are operands
+    hash.update(F->getChecksum() ? F->getChecksum()->Kind + 1 : 0);
+    return true;
+  } else if (const DICompileUnit *CU = dyn_cast<DICompileUnit>(N)) {
+    hash.update(CU->getSourceLanguage());
+    hash.update(CU->isOptimized());
+    hash.update(CU->getRuntimeVersion());
+    hash.update(CU->getEmissionKind());
+    hash.update(CU->getDWOId());
+    hash.update(CU->getSplitDebugInlining());
+    hash.update(CU->getDebugInfoForProfiling());
+    hash.update((unsigned)CU->getNameTableKind());
+    hash.update(CU->getRangesBaseAddress());
+    return true;
+  } else if (const DIEnumerator *E = dyn_cast<DIEnumerator>(N)) {
+    hash.update(E->isUnsigned());
+    hash.update(E->getValue().getBitWidth());
+    hash.update((void *)E->getValue().getRawData(), sizeof(uint64_t) * E->getValue().getNumWords());
+    return true;
+  }
+
+  const DIType *T = dyn_cast<DIType>(N);
+  if (!T || !(isa<DIBasicType>(T) || isa<DIDerivedType>(T) || isa<DICompositeType>(T) || isa<DISubroutineType>(T))) {
+    return false;
+  }
+  hash.update(T->getTag());
+  hash.update(T->getLine());
+  hash.update(T->getSizeInBits());
+  hash.update(T->getAlignInBits());
+  hash.update(T->getOffsetInBits());
+  hash.update(T->getFlags());
+  if (const DIBasicType *B = dyn_cast<DIBasicType>(T)) {
+    hash.update(B->getEncoding());
+  } else if (const DIDerivedType *D = dyn_cast<DIDerivedType>(T)) {
+    hash.update(D->getDWARFAddressSpace() ? *D->getDWARFAddressSpace() + 1 : 0);
+  } else if (const DICompositeType *C = dyn_cast<DICompositeType>(T)) {
+    hash.update(C->getRuntimeLang());
+  } else {
+    hash.update(cast<DISubroutineType>(T)->getCC());
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// Hash the named metadata and every node of \p Ctx.MD once, in slot order.
+void IRHashPass::hashMetadataNodes(const Module &M, HashContext &Ctx, Hasher &hash) {
+  const MetadataSlots &MD = *Ctx.MD;
+  for (const NamedMDNode &NMD : M.named_metadata()) {
+    hash.update(NMD.getName().size());
+    hash.update(NMD.getName());
+    hash.update(NMD.getNumOperands());
+    for (const MDNode *N : NMD.operands()) {
+      hash.update(MD.get(N));
+    }
+  }
+
+  // Most nodes (locations, scopes, variables, types and lists) are hashed by
+  // their fields and operands. The printer writes all fields of the others,
+  // and numbers the nodes deterministically, too.
+  std::optional<ModuleSlotTracker> MST;
+  std::string Text;
+  raw_string_ostream OS(Text);
+  for (const MDNode *N : MD.Nodes) {
+    hash.update(N->getMetadataID());
+    hash.update(N->isDistinct());
+    if (hash_metadata_fields(N, hash)) {
+      hash.update(N->getNumOperands());
+      for (const MDOperand &Op : N->operands()) {
+        hashMetadata(Op.get(), Ctx, hash);
+      }
+      continue;
     }
+    if (!MST) {
+      MST.emplace(&M, /*ShouldInitializeAllMetadata=*/true);
+    }
+    Text.clear();
+    N->print(OS, *MST, &M);
+    OS.flush();
+    hash.update(Text.size());
+    hash.update(Text);
   }
 }
 
-void IRHashPass::hashValue(const Constant *CV, Hasher &hash) {
+/// Hash a metadata operand of an instruction or metadata node.
+void IRHashPass::hashMetadata(const Metadata *MD, HashContext &Ctx, Hasher &hash) {
+  hash.update(MD != nullptr);
+  if (!MD) {
+    return;
+  }
+  hash.update(MD->getMetadataID());
+
+  if (const DIArgList *AL = dyn_cast<DIArgList>(MD)) {
+    hash.update(AL->getArgs().size());
+    for (const ValueAsMetadata *Arg : AL->getArgs()) {
+      hashMetadata(Arg, Ctx, hash);
+    }
+  } else if (const MDNode *N = dyn_cast<MDNode>(MD)) {
+    hash.update(Ctx.MD->get(N));
+  } else if (const MDString *S = dyn_cast<MDString>(MD)) {
+    hash.update(S->getLength());
+    hash.update(S->getString());
+  } else if (const ConstantAsMetadata *C = dyn_cast<ConstantAsMetadata>(MD)) {
+    hashType(C->getType(), Ctx, hash);
+    hashValue(C->getValue(), Ctx, hash);
+  } else if (const LocalAsMetadata *L = dyn_cast<LocalAsMetadata>(MD)) {
+    const Value *V = L->getValue();
+    hashType(V->getType(), Ctx, hash);
+    if (V->hasName() && !Ctx.Canonical) {
+      hash.update(V->getName());
+    } else if (const Argument *Arg = dyn_cast<Argument>(V)) {
+      hash.update(Arg->getArgNo());
+    } else {
+      hash.update(Ctx.Slots.get(V));
+    }
+  }
+}
+
+/// Hash the debug records in front of \p I. From LLVM 19, they hold the
+/// variable locations and labels instead of llvm.dbg.* calls.
+void IRHashPass::hashDebugRecords(const Instruction &I, HashContext &Ctx, Hasher &hash) {
+#if LLVM_VERSION_MAJOR >= 19
+  auto Records = I.getDbgRecordRange();
+  hash.update((uint64_t)std::distance(Records.begin(), Records.end()));
+  SmallVector<const Metadata *, 8> Ops;
+  for (const DbgRecord &DR : Records) {
+    hash.update((uint64_t)DR.getRecordKind());
+    if (const DbgVariableRecord *DVR = dyn_cast<DbgVariableRecord>(&DR)) {
+      // dbg_declare, dbg_value or dbg_assign
+      hash.update((uint64_t)DVR->getType());
+    }
+    debug_record_operands(DR, Ops);
+    for (const Metadata *Op : Ops) {
+      hashMetadata(Op, Ctx, hash);
+    }
+  }
+#endif
+}
+
+/// Hash the metadata attached to an instruction or global, \p MDs as
+/// getAllMetadata() returns it.
+void IRHashPass::hashAttachments(ArrayRef<std::pair<unsigned, MDNode *>> MDs, HashContext &Ctx, Hasher &hash) {
+  hash.update(MDs.size());
+  for (const auto &[Kind, N] : MDs) {
+    // Kinds other than the fixed ones are numbered in the order the compiler registers them
+    const StringRef Name = Ctx.MD->KindNames[Kind];
+    hash.update(Name.size());
+    hash.update(Name);
+    hash.update(Ctx.MD->get(N));
+  }
+}
+
+void IRHashPass::hashValue(const Constant *CV, HashContext &Ctx, Hasher &hash) {
   if (CV->hasName()) {
     hash.update(CV->getName());
   }
 
+  // The same bits are another constant with another type, e.g. i32 1 and i64 1
   if (const ConstantInt *CI = dyn_cast<ConstantInt>(CV)) {
     const APInt I = CI->getValue();
+    hash.update(I.getBitWidth());
     hash.update((void *)I.getRawData(), sizeof(uint64_t) * I.getNumWords());
     return;
   }
 
   if (const ConstantFP *CFP = dyn_cast<ConstantFP>(CV)) {
     const APInt I = CFP->getValueAPF().bitcastToAPInt();
+    hash.update(CFP->getType()->getTypeID());
     hash.update((void *)I.getRawData(), sizeof(uint64_t) * I.getNumWords());
     return;
   }
 
-  // Array, Struct, Vector
-  if (const ConstantAggregate *CA = dyn_cast<ConstantAggregate>(CV)) {
-    const unsigned N = CA->getNumOperands();
-    for (unsigned i = 0; i < N; i++) {
-      hashValue(CA->getOperand(i), hash);
-    }
-    return;
-  }
-
-  // constant data arrays/vectors
-  if (const ConstantDataSequential *CA = dyn_cast<ConstantDataSequential>(CV)) {
-    for (unsigned i = 0, e = CA->getNumElements(); i != e; ++i) {
-      hashValue(CA->getElementAsConstant(i), hash);
+  // Arrays, structs, vectors and constant data are often shared by many
+  // instructions and globals, so each of them is only hashed once per module.
+  if (isa<ConstantAggregate>(CV) || isa<ConstantDataSequential>(CV)) {
+    auto It = Ctx.ConstantDigests.find(CV);
+    if (It == Ctx.ConstantDigests.end()) {
+      Hasher CHash;
+      hashAggregate(CV, Ctx, CHash);
+
+      Hasher::Digest digest;
+      CHash.final(digest);
+      It = Ctx.ConstantDigests.insert({CV, digest}).first;
     }
+    hash.update(It->second);
     return;
   }
 
@@ -276,6 +1355,7 @@ void IRHashPass::hashValue(const Constant *CV, Hasher &hash) {
   if (isa<ConstantAggregateZero>(CV) || isa<ConstantTokenNone>(CV) || isa<ConstantAggregateZero>(CV) ||
       isa<ConstantTokenNone>(CV) || isa<ConstantPointerNull>(CV) || isa<ConstantTokenNone>(CV) ||
       isa<PoisonValue>(CV) || isa<UndefValue>(CV)) {
+    hashType(CV->getType(), Ctx, hash);
     hash.update(isa<ConstantAggregateZero>(CV));
     hash.update(isa<ConstantTargetNone>(CV));
     hash.update(isa<ConstantPointerNull>(CV));
@@ -297,9 +1377,21 @@ void IRHashPass::hashValue(const Constant *CV, Hasher &hash) {
 
   if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(CV)) {
     hash.update(CE->getOpcode());
+    hashType(CE->getType(), Ctx, hash);
+    hash.update(CE->getRawSubclassOptionalData());
+    if (const GEPOperator *GEP = dyn_cast<GEPOperator>(CE)) {
+      hashType(GEP->getSourceElementType(), Ctx, hash);
+    }
+#if LLVM_VERSION_MAJOR <= 18
+    if (CE->isCompare()) {
+      hash.update(CE->getPredicate());
+    }
+#endif
 
-    for (User::const_op_iterator OI = CE->op_begin(); OI != CE->op_end(); ++OI) {
-      hash.update((*OI)->getName());
+    // Globals are hashed by name, other operands (e.g. the indices of a
+    // getelementptr) by value
+    for (const Use &Op : CE->operands()) {
+      hashValue(cast<Constant>(Op.get()), Ctx, hash);
     }
     return;
   }
@@ -336,7 +1428,82 @@ void IRHashPass::hashValue(const Constant *CV, Hasher &hash) {
   llvm_unreachable("Unhandled Constant");
 }
 
-void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
+void IRHashPass::hashAggregate(const Constant *CV, HashContext &Ctx, Hasher &hash) {
+  // Array, Struct, Vector
+  if (const ConstantAggregate *CA = dyn_cast<ConstantAggregate>(CV)) {
+    hashType(CA->getType(), Ctx, hash);
+    const unsigned N = CA->getNumOperands();
+    for (unsigned i = 0; i < N; i++) {
+      hashValue(CA->getOperand(i), Ctx, hash);
+    }
+    return;
+  }
+
+  // constant data arrays/vectors are hashed in bulk from their raw buffer.
+  // The type tells the element width, which the raw bytes don't.
+  const ConstantDataSequential *CA = cast<ConstantDataSequential>(CV);
+  hashType(CA->getType(), Ctx, hash);
+  hash.update(CA->getRawDataValues());
+}
+
+void IRHashPass::hashAttributes(AttributeSet Attrs, HashContext &Ctx, Hasher &hash) {
+  hash.update(Attrs.getNumAttributes());
+  for (const Attribute &A : Attrs) {
+    if (A.isStringAttribute()) {
+      // e.g. "target-cpu"="x86-64"
+      hash.update(A.getKindAsString().size());
+      hash.update(A.getKindAsString());
+      hash.update(A.getValueAsString().size());
+      hash.update(A.getValueAsString());
+      continue;
+    }
+    hash.update(A.getKindAsEnum());
+    if (A.isIntAttribute()) {
+      hash.update(A.getValueAsInt());
+    } else if (A.isTypeAttribute()) {
+      if (Type *Ty = A.getValueAsType()) {
+        hashType(Ty, Ctx, hash);
+      }
+    } else if (!A.isEnumAttribute()) {
+      // Attributes with other values, e.g. ranges
+      hash.update(A.getAsString());
+    }
+  }
+}
+
+void IRHashPass::hashAttributes(const AttributeList &Attrs, HashContext &Ctx, Hasher &hash) {
+  // Which parameter an attribute belongs to matters as well
+  for (unsigned Index : Attrs.indexes()) {
+    const AttributeSet Set = Attrs.getAttributes(Index);
+    if (Set.hasAttributes()) {
+      hash.update(Index);
+      hashAttributes(Set, Ctx, hash);
+    }
+  }
+}
+
+void IRHashPass::hashType(const Type *Ty, HashContext &Ctx, Hasher &hash) {
+  // Scalar types are a field or two, cheaper to hash than to look up
+  if (Ty->isIntOrPtrTy() || Ty->isFloatingPointTy() || Ty->isVoidTy()) {
+    hashTypeUncached(Ty, Ctx, hash);
+    return;
+  }
+
+  // Types are uniqued in the LLVMContext, so every distinct type is only
+  // walked once per module. Later uses just add its digest.
+  auto It = Ctx.TypeDigests.find(Ty);
+  if (It == Ctx.TypeDigests.end()) {
+    Hasher TyHash;
+    hashTypeUncached(Ty, Ctx, TyHash);
+
+    Hasher::Digest digest;
+    TyHash.final(digest);
+    It = Ctx.TypeDigests.insert({Ty, digest}).first;
+  }
+  hash.update(It->second);
+}
+
+void IRHashPass::hashTypeUncached(const Type *Ty, HashContext &Ctx, Hasher &hash) {
   hash.update(Ty->getTypeID());
 
   switch (Ty->getTypeID()) {
@@ -372,9 +1539,9 @@ void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
 
   case Type::FunctionTyID: {
     const FunctionType *FTy = cast<FunctionType>(Ty);
-    hashType(FTy->getReturnType(), hash);
+    hashType(FTy->getReturnType(), Ctx, hash);
     for (Type *Ty : FTy->params()) {
-      hashType(Ty, hash);
+      hashType(Ty, Ctx, hash);
     }
     hash.update(FTy->isVarArg());
     return;
@@ -386,6 +1553,9 @@ void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
     if (!name.empty()) {
       // hash globaly once and just hash the name afterwards
       hash.update(name);
+      if (Ctx.Prune) {
+        Ctx.Structs.insert(STy);
+      }
       return;
     }
 
@@ -394,7 +1564,7 @@ void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
     hash.update(STy->isPacked());
 
     for (Type *Ty : STy->elements()) {
-      hashType(Ty, hash);
+      hashType(Ty, Ctx, hash);
     }
 
     return;
@@ -408,14 +1578,14 @@ void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
     if (PTy->isOpaque()) {
       return;
     }
-    hashType(PTy->getNonOpaquePointerElementType(), hash);
+    hashType(PTy->getNonOpaquePointerElementType(), Ctx, hash);
 #endif
     return;
   }
   case Type::ArrayTyID: {
     const ArrayType *ATy = cast<ArrayType>(Ty);
     hash.update(ATy->getNumElements());
-    hashType(ATy->getElementType(), hash);
+    hashType(ATy->getElementType(), Ctx, hash);
     return;
   }
   case Type::FixedVectorTyID:
@@ -424,20 +1594,20 @@ void IRHashPass::hashType(const Type *Ty, Hasher &hash) {
     ElementCount EC = PTy->getElementCount();
     hash.update(EC.isScalable());
     hash.update(EC.getKnownMinValue());
-    hashType(PTy->getElementType(), hash);
+    hashType(PTy->getElementType(), Ctx, hash);
     return;
   }
   case Type::TypedPointerTyID: {
     llvm_unreachable("Invalid TypeID??");
     // TypedPointerType *TPTy = cast<TypedPointerType>(Ty);
-    // hashType(*TPTy->getElementType(), hash);
+    // hashType(*TPTy->getElementType(), Ctx, hash);
     // return;
   }
   case Type::TargetExtTyID:
     const TargetExtType *TETy = cast<TargetExtType>(Ty);
     hash.update(Ty->getTargetExtName());
     for (Type *Inner : TETy->type_params())
-      hashType(Inner, hash);
+      hashType(Inner, Ctx, hash);
     for (unsigned IntParam : TETy->int_params())
       hash.update(IntParam);
     return;
@@ -452,67 +1622,550 @@ bool IRHashPass::isStatic(const GlobalValue *GV) {
   return linkage == GlobalValue::InternalLinkage || linkage == GlobalValue::PrivateLinkage;
 }
 
-std::string IRHashPass::getOutFile() {
+HashOptions HashOptions::fromEnv() {
+  HashOptions Options;
+  Options.DebugInfo = getenv("IRHASH_DEBUGINFO") != nullptr;
+  Options.Canonical = getenv("IRHASH_CANONICAL") != nullptr;
+  Options.Unordered = getenv("IRHASH_UNORDERED") != nullptr;
+  Options.Prune = getenv("IRHASH_PRUNE") != nullptr;
+  return Options;
+}
+
+/// Number of hashing threads, configured by IRHASH_THREADS (0 = all cores).
+unsigned IRHashPass::getThreadCount() {
+  const char *threads = getenv("IRHASH_THREADS");
+  if (!threads) {
+    return 1;
+  }
+  unsigned N;
+  if (StringRef(threads).getAsInteger(10, N)) {
+    llvm::report_fatal_error("IRHASH_THREADS is not a number");
+  }
+  if (N == 0) {
+    N = hardware_concurrency().compute_thread_count();
+  }
+  return N;
+}
+
+/// The arguments of the compiler.
+static const std::vector<std::string> &command_line() {
+  static const std::vector<std::string> args = [] {
+    std::vector<std::string> args;
+    std::ifstream CommandLine{"/proc/self/cmdline"};
+    for (std::string Arg; getline(CommandLine, Arg, '\0');) {
+      args.push_back(Arg);
+    }
+    return args;
+  }();
+  return args;
+}
+
+/// Value of the option \p name in \p args, as `name value`, `name=value` or,
+/// if \p joined, `namevalue`. The last occurrence wins, like in the
+/// compilers. Values of \p name are collected in \p all if given.
+static std::optional<std::string> option(ArrayRef<std::string> args, StringRef name, bool joined = false,
+                                         std::vector<std::string> *all = nullptr) {
+  std::optional<std::string> value;
+  for (size_t i = 0; i < args.size(); i++) {
+    StringRef arg(args[i]);
+    if (arg == name && i + 1 < args.size()) {
+      value = args[++i];
+    } else if (arg.consume_front(name) && (joined || arg.consume_front("="))) {
+      value = arg.str();
+    } else {
+      continue;
+    }
+    if (all) {
+      all->push_back(*value);
+    }
+  }
+  return value;
+}
+
+/// Value of the rustc codegen option (\p kind "C", `-C name=value`) or
+/// unstable option ("Z") \p name in \p args.
+static std::optional<std::string> rustc_flag(ArrayRef<std::string> args, StringRef kind, StringRef name) {
+  std::vector<std::string> values;
+  option(args, ("-" + kind).str(), true, &values);
+  if (kind == "C") {
+    option(args, "--codegen", false, &values);
+  }
+  std::optional<std::string> value;
+  for (StringRef setting : values) {
+    auto [key, rest] = setting.split('=');
+    if (key == name) {
+      value = rest.str();
+    }
+  }
+  return value;
+}
+
+/// Does rustc write bitcode for the linker to optimize (-C linker-plugin-lto)?
+/// The linker does the LTO then, not rustc.
+static bool rustc_linker_plugin_lto(ArrayRef<std::string> args) {
+  // The value is the path of the plugin, or a boolean
+  std::optional<std::string> value = rustc_flag(args, "C", "linker-plugin-lto");
+  return value && *value != "no" && *value != "n" && *value != "off" && *value != "false";
+}
+
+/// The options which decide what a compiler writes for a module besides the
+/// module itself.
+struct OutputOptions {
+  StringRef lto;          // "thin-lto" or "full-lto" if the output is meant for LTO
+  bool emit_llvm = false; // LLVM IR instead of machine code
+  bool assembly = false;  // text instead of an object file or bitcode
+  bool fat = false;       // an object file with the bitcode for LTO embedded
+  std::vector<std::string> options;     // which change the output, e.g. the options of the LTO summary
+  ObjectCache::Artifacts extras;        // further files the compiler writes besides the output
+  std::optional<std::string> dwo_name; // split DWARF file named in the object file
+
+  /// The kind of the output, see IRHashPass::ModuleOutput.
+  std::string kind() const {
+    std::vector<std::string> parts;
+    if (!lto.empty()) {
+      parts.push_back(lto.str());
+    }
+    if (assembly) {
+      parts.push_back(emit_llvm || !lto.empty() ? "llvm-ir" : "assembly");
+    } else if (emit_llvm && lto.empty()) {
+      parts.push_back("bitcode");
+    }
+    if (!lto.empty() && fat) {
+      parts.push_back("fat-lto-objects");
+    }
+    parts.insert(parts.end(), options.begin(), options.end());
+    if (dwo_name) {
+      parts.push_back("split-dwarf-file=" + *dwo_name);
+    }
+    // The entry is a bundle of these files
+    for (const auto &[role, path] : extras) {
+      parts.push_back("+" + role);
+    }
+    return join(parts, ",");
+  }
+
+  bool bitcode() const { return !assembly && (emit_llvm || (!lto.empty() && !fat)); }
+};
+
+/// Output options of a clang invocation with \p args. Options which come in
+/// pairs, like -fsplit-lto-unit and -fno-split-lto-unit, count by their last
+/// occurrence.
+static OutputOptions clang_output_options(ArrayRef<std::string> args) {
+  OutputOptions options;
+  bool unified = false, split = false, vtables = false;
+  const std::pair<StringRef, bool *> toggles[] = {
+      {"fat-lto-objects", &options.fat},
+      {"unified-lto", &unified},
+      {"split-lto-unit", &split},
+      {"whole-program-vtables", &vtables},
+  };
+  for (StringRef arg : args) {
+    if (arg == "-flto" || arg == "-flto=full" || arg == "-flto=auto" || arg == "-flto=jobserver") {
+      options.lto = "full-lto";
+    } else if (arg == "-flto=thin") {
+      options.lto = "thin-lto";
+    } else if (arg == "-fno-lto") {
+      options.lto = "";
+    } else if (arg == "-emit-llvm") {
+      options.emit_llvm = true;
+    } else if (arg == "-S") {
+      options.assembly = true;
+    } else if (arg.consume_front("-f")) {
+      const bool enable = !arg.consume_front("no-");
+      for (const auto &[name, value] : toggles) {
+        if (arg == name) {
+          *value = enable;
+        }
+      }
+    }
+  }
+  for (const auto &[name, value] : ArrayRef(toggles).drop_front()) {
+    if (*value) {
+      options.options.push_back(name.str());
+    }
+  }
+  return options;
+}
+
+/// Further files of a clang invocation with \p args besides \p objectfile.
+/// The driver names them after the object file, -cc1 gets their paths.
+static void clang_extras(ArrayRef<std::string> args, StringRef objectfile, OutputOptions &options) {
+  auto next_to_object = [&](StringRef extension) {
+    SmallString<256> path(objectfile);
+    sys::path::replace_extension(path, extension);
+    return std::string(path);
+  };
+
+  bool split_dwarf = false;
+  std::optional<std::string> time_trace, opt_record, stack_usage;
+  for (size_t i = 0; i < args.size(); i++) {
+    StringRef arg(args[i]);
+    const bool has_value = i + 1 < args.size();
+    if (arg == "-gsplit-dwarf" || arg == "-gsplit-dwarf=split") {
+      split_dwarf = true;
+    } else if (arg == "-gsplit-dwarf=single" || arg == "-gno-split-dwarf") {
+      split_dwarf = false;
+    } else if (arg == "-split-dwarf-output" && has_value) {
+      options.extras.push_back({"dwo", args[++i]});
+    } else if (arg == "-split-dwarf-file" && has_value) {
+      options.dwo_name = args[++i];
+    } else if (arg == "-ftime-trace") {
+      time_trace = next_to_object(".json");
+    } else if (arg.consume_front("-ftime-trace=")) {
+      // A directory gets a trace named after the object file
+      time_trace = arg.ends_with("/") || sys::fs::is_directory(arg)
+                       ? (arg.rtrim('/') + "/" + sys::path::filename(next_to_object(".json"))).str()
+                       : arg.str();
+    } else if (arg == "-fsave-optimization-record" || arg == "-fsave-optimization-record=yaml") {
+      opt_record = next_to_object(".opt.yaml");
+    } else if (arg == "-fsave-optimization-record=bitstream") {
+      opt_record = next_to_object(".opt.bitstream");
+    } else if (arg.consume_front("-foptimization-record-file=")) {
+      opt_record = arg.str();
+    } else if (arg == "-opt-record-file" && has_value) {
+      opt_record = args[++i];
+    } else if (arg == "-fstack-usage") {
+      stack_usage = next_to_object(".su");
+    } else if (arg == "-stack-usage-file" && has_value) {
+      stack_usage = args[++i];
+    }
+  }
+
+  if (split_dwarf) {
+    options.extras.push_back({"dwo", next_to_object(".dwo")});
+    options.dwo_name = options.extras.back().second;
+  }
+  for (const auto &[role, path] : {std::pair{"time-trace", time_trace}, std::pair{"opt-record", opt_record},
+                                   std::pair{"stack-usage", stack_usage}}) {
+    if (path) {
+      options.extras.push_back({role, *path});
+    }
+  }
+}
+
 #ifdef WITH_CLANG_PLUGIN
-  return CLANG_CI->getFrontendOpts().OutputFile;
-#else
-  // get Outfile
-  std::string OutputFile;
-  std::ifstream CommandLine{"/proc/self/cmdline"};
-  if (CommandLine.good()) {
-    std::string Arg;
-    do {
-      getline(CommandLine, Arg, '\0');
-      if ("-o" == Arg) {
-        getline(CommandLine, OutputFile, '\0');
-        break;
+/// Output options of the compilation of the Clang plugin.
+static OutputOptions clang_output_options(const CompilerInstance &CI) {
+  const CodeGenOptions &codegen = CI.getCodeGenOpts();
+  const frontend::ActionKind action = CI.getFrontendOpts().ProgramAction;
+  OutputOptions options;
+  options.lto = codegen.PrepareForThinLTO ? "thin-lto" : codegen.PrepareForLTO ? "full-lto" : "";
+  options.emit_llvm = action == frontend::EmitBC || action == frontend::EmitLLVM;
+  options.assembly = action == frontend::EmitAssembly || action == frontend::EmitLLVM;
+  options.fat = codegen.FatLTO;
+  const std::pair<StringRef, bool> summary[] = {
+      {"unified-lto", (bool)codegen.UnifiedLTO},
+      {"split-lto-unit", (bool)codegen.EnableSplitLTOUnit},
+      {"whole-program-vtables", (bool)codegen.WholeProgramVTables},
+  };
+  for (const auto &[name, enabled] : summary) {
+    if (enabled) {
+      options.options.push_back(name.str());
+    }
+  }
+
+  if (!codegen.SplitDwarfFile.empty()) {
+    options.dwo_name = codegen.SplitDwarfFile;
+  }
+  const std::pair<const char *, const std::string &> extras[] = {
+      {"dwo", codegen.SplitDwarfOutput},
+      {"time-trace", CI.getFrontendOpts().TimeTracePath},
+      {"opt-record", codegen.OptRecordFile},
+      {"stack-usage", codegen.StackUsageOutput},
+  };
+  for (const auto &[role, path] : extras) {
+    if (!path.empty()) {
+      options.extras.push_back({role, path});
+    }
+  }
+  return options;
+}
+#endif
+
+/// Object file of the codegen unit \p M of a rustc invocation with \p args,
+/// empty if it isn't the final object file of the unit. \p thin_local is set
+/// if the unit is linked with the others by ThinLTO within the crate first.
+static std::string rustc_output(const Module &M, ArrayRef<std::string> args, bool &thin_local) {
+  // Only the object files of the codegen units are cached, they are only
+  // final if no other output is derived from the module
+  std::vector<std::string> emit_lists;
+  option(args, "--emit", false, &emit_lists);
+  bool object = emit_lists.empty(); // links by default
+  for (StringRef list : emit_lists) {
+    SmallVector<StringRef, 4> kinds;
+    list.split(kinds, ',');
+    for (StringRef kind : kinds) {
+      kind = kind.split('=').first;
+      if (kind == "link" || kind == "obj") {
+        object = true;
+      } else if (kind != "metadata" && kind != "dep-info") {
+        return "";
       }
-    } while (Arg.size());
+    }
+  }
+  if (!object || rustc_flag(args, "C", "save-temps").value_or("no") != "no") {
+    return "";
+  }
+
+  // With LTO, the object files are compiled from the optimized bitcode of all
+  // codegen units. Without -C lto, optimized builds with more than one
+  // codegen unit use ThinLTO within the crate, its backend compiles each unit
+  // with what it imports from the others.
+  const std::string lto = rustc_flag(args, "C", "lto").value_or("");
+  if (lto == "fat" || lto == "thin" || lto == "yes" || lto == "y" || lto == "on" || lto == "true" ||
+      (lto.empty() && rustc_flag(args, "C", "lto"))) {
+    return "";
+  }
+  std::string opt_level = rustc_flag(args, "C", "opt-level").value_or("0");
+  if (std::find(args.begin(), args.end(), "-O") != args.end()) {
+    opt_level = "2";
+  }
+  const std::string codegen_units = rustc_flag(args, "C", "codegen-units").value_or("");
+  thin_local = lto.empty() && opt_level != "0" && codegen_units != "1" && !rustc_linker_plugin_lto(args) &&
+               rustc_flag(args, "Z", "thinlto").value_or("") != "no";
+
+  // The codegen unit is the module, its object file is
+  // <dir>/<crate name><extra filename>.<codegen unit>.rcgu.o
+  const std::optional<std::string> out = option(args, "-o");
+  SmallString<256> dir(option(args, "--out-dir").value_or(out ? sys::path::parent_path(*out).str() : ""));
+  if (std::optional<std::string> temps = rustc_flag(args, "Z", "temps-dir")) {
+    dir = *temps;
+  }
+  std::string stem = option(args, "--crate-name").value_or(out ? sys::path::stem(*out).str() : "");
+  if (stem.empty()) {
+    return "";
+  }
+  stem += rustc_flag(args, "C", "extra-filename").value_or("");
+  sys::path::append(dir, stem + "." + M.getModuleIdentifier() + ".rcgu.o");
+  return std::string(dir);
+}
+
+IRHashPass::ModuleOutput IRHashPass::getClangOutput() {
+#ifdef WITH_CLANG_PLUGIN
+  // -fthin-link-bitcode writes a second bitcode file
+  if (CLANG_CI && CLANG_CI->getCodeGenOpts().ThinLinkBitcodeFile.empty()) {
+    const OutputOptions options = clang_output_options(*CLANG_CI);
+    return {CLANG_CI->getFrontendOpts().OutputFile, HitMode::Exit, options.kind(), options.bitcode(), options.extras};
   }
-  return OutputFile;
 #endif
+  return {};
 }
 
-void IRHashPass::link_object_file() {
-  assert(atexit_mode != ATEXIT_NOP);
+IRHashPass::ModuleOutput IRHashPass::getOutput(const Module &M) {
+  auto output = [](std::string objectfile, HitMode mode, const OutputOptions &options) {
+    return ModuleOutput{objectfile, mode, options.kind(), options.bitcode(), options.extras};
+  };
 
-  const char *src, *dst;
+#ifdef WITH_CLANG_PLUGIN
+  if (CLANG_CI) {
+    return getClangOutput();
+  }
+#endif
+  ArrayRef<std::string> args(command_line());
+  if (args.empty()) {
+    return {};
+  }
 
-  if (atexit_mode == ATEXIT_FROM_CACHE) {
-    src = objectfile_copy;
-    dst = objectfile;
-  } else {
-    src = objectfile;
-    dst = objectfile_copy;
+  // rustc compiles its codegen units in parallel and keeps running afterwards
+  if (sys::path::stem(args[0]).contains("rustc") || option(args, "--crate-name")) {
+    OutputOptions options;
+    if (rustc_linker_plugin_lto(args)) {
+      options.lto = "thin-lto";
+    }
+    // The optimized bitcode in the object files of rlibs
+    if (std::optional<std::string> embed = rustc_flag(args, "C", "embed-bitcode")) {
+      options.options.push_back("embed-bitcode=" + *embed);
+    }
+    bool thin_local = false;
+    const std::string objectfile = rustc_output(M, args, thin_local);
+    if (thin_local) {
+      options.options.push_back("thin-lto-post-link");
+    }
+    // Split DWARF of a codegen unit is next to its object file
+    const std::string split = rustc_flag(args, "C", "split-debuginfo").value_or("off");
+    if (!objectfile.empty() && (split == "packed" || split == "unpacked")) {
+      SmallString<256> dwo(objectfile);
+      sys::path::replace_extension(dwo, ".dwo");
+      options.options.push_back("split-debuginfo=" + split);
+      options.extras.push_back({"dwo", std::string(dwo)});
+    }
+    ModuleOutput result = output(objectfile, HitMode::OnDestroy, options);
+    result.post_link = thin_local;
+    return result;
   }
 
-  /* If destination exists, we have to unlink it. */
-  struct stat dummy;
-  if (stat(dst, &dummy) == 0) { // exists
-    if (unlink(dst) != 0) {     // unlink failed
-      errs() << "dst=" << dst << '\n';
-      perror("irhash: unlink objectfile/objectfile copy");
-      return;
+  OutputOptions options = clang_output_options(args);
+  if (option(args, "-fthin-link-bitcode")) {
+    return {};
+  }
+  std::optional<std::string> out = option(args, "-o");
+  if (!out) {
+    out = option(args, "--output");
+  }
+  HitMode mode = HitMode::Exit;
+  // clang -c foo.c writes foo.o, but the process may compile more sources
+  if (!out && (std::find(args.begin(), args.end(), "-c") != args.end() ||
+               std::find(args.begin(), args.end(), "-S") != args.end())) {
+    SmallString<256> path(sys::path::filename(M.getSourceFileName()));
+    sys::path::replace_extension(path, options.assembly ? (options.emit_llvm ? ".ll" : ".s")
+                                                        : (options.emit_llvm ? ".bc" : ".o"));
+    out = std::string(path);
+    mode = HitMode::AtExit;
+  }
+  if (!out) {
+    return {};
+  }
+  clang_extras(args, *out, options);
+  return output(*out, mode, options);
+}
+
+/// Options of a clang invocation with \p args which change the code
+/// generated for the target besides the triple: the -m options of the driver
+/// and -cc1 (e.g. -march=, -mcmodel=, -mavx2), the target options of -cc1,
+/// position independence and sanitizers.
+static void clang_configuration(ArrayRef<std::string> args, std::vector<std::string> &parts) {
+  const StringRef separate[] = {"-target-cpu",        "-tune-cpu",  "-target-feature", "-target-abi",
+                                "-mrelocation-model", "-pic-level", "-mllvm",          "-mlink-bitcode-file",
+                                "-mlink-builtin-bitcode"};
+  const StringRef flags[] = {"-fpic",    "-fPIC",    "-fpie",    "-fPIE",       "-fno-pic",
+                             "-fno-PIC", "-fno-pie", "-fno-PIE", "-pic-is-pie", "-static"};
+  // Backend options which the IR doesn't show. Without IRHASH_DEBUGINFO, the
+  // key doesn't cover the debug info either.
+  const StringRef codegen[] = {"-ffunction-sections",    "-fno-function-sections",   "-fdata-sections",
+                               "-fno-data-sections",     "-femulated-tls",           "-fno-emulated-tls",
+                               "-fsplit-dwarf-inlining", "-fno-split-dwarf-inlining"};
+  const StringRef codegen_joined[] = {"-fbasic-block-sections=", "-debug-info-kind=", "-dwarf-version=",
+                                      "-debugger-tuning="};
+  for (size_t i = 0; i < args.size(); i++) {
+    StringRef arg(args[i]);
+    const bool has_value = i + 1 < args.size();
+    if (is_contained(separate, arg) && has_value) {
+      parts.push_back((arg + "=" + args[++i]).str());
+    } else if (arg == "-main-file-name" && has_value) {
+      i++;
+    } else if ((arg.starts_with("-m") && arg.size() > 2) || (arg.starts_with("-g") && arg.size() > 2) ||
+               arg.starts_with("-fsanitize") || arg.starts_with("-fno-sanitize") || is_contained(flags, arg) ||
+               is_contained(codegen, arg) ||
+               any_of(codegen_joined, [&](StringRef prefix) { return arg.starts_with(prefix); })) {
+      parts.push_back(arg.str());
     }
   }
-  if (stat(src, &dummy) != 0) { // src exists
-    errs() << "src=" << src << '\n';
-    perror("irhash: source objectfile/objectfile copy does not exist");
-    return;
+}
+
+/// Options of a rustc invocation with \p args which change the code generated
+/// for the target besides the triple.
+static void rustc_configuration(ArrayRef<std::string> args, std::vector<std::string> &parts) {
+  std::vector<std::string> codegen, unstable;
+  option(args, "-C", true, &codegen);
+  option(args, "--codegen", false, &codegen);
+  option(args, "-Z", true, &unstable);
+  const std::pair<std::vector<std::string> &, std::vector<StringRef>> settings[] = {
+      {codegen,
+       {"target-cpu", "target-feature", "relocation-model", "code-model", "force-frame-pointers", "llvm-args"}},
+      {unstable, {"tune-cpu", "sanitizer", "sanitizer-recover", "plt"}},
+  };
+  // -C target-feature and the like add up, so every occurrence counts
+  for (const auto &[values, names] : settings) {
+    for (StringRef setting : values) {
+      if (is_contained(names, setting.split('=').first)) {
+        parts.push_back(setting.str());
+      }
+    }
   }
+}
 
-  // Copy by hardlink
-  if (link(src, dst) != 0) {
-    errs() << "src=" << src << " dst=" << dst << '\n';
-    perror("irhash: objectfile update failed");
-    return;
+#ifdef WITH_CLANG_PLUGIN
+/// Target and sanitizer options of the compilation of the Clang plugin.
+static void clang_configuration(const CompilerInstance &CI, std::vector<std::string> &parts) {
+  const TargetOptions &target = CI.getTargetOpts();
+  const CodeGenOptions &codegen = CI.getCodeGenOpts();
+  const char *const relocation_models[] = {"static", "pic", "dynamic-no-pic", "ropi", "rwpi", "ropi-rwpi"};
+  parts.push_back("cpu=" + target.CPU);
+  parts.push_back("tune-cpu=" + target.TuneCPU);
+  parts.push_back("abi=" + target.ABI);
+  parts.push_back("features=" + join(target.Features, " "));
+  parts.push_back(std::string("reloc=") + relocation_models[codegen.RelocationModel]);
+  parts.push_back("code-model=" + codegen.CodeModel);
+  if (CI.getLangOpts().PIE) {
+    parts.push_back("pie");
+  }
+  if (codegen.FunctionSections) {
+    parts.push_back("function-sections");
+  }
+  if (codegen.DataSections) {
+    parts.push_back("data-sections");
+  }
+  if (!codegen.BBSections.empty()) {
+    parts.push_back("bb-sections=" + codegen.BBSections);
+  }
+  if (codegen.EmulatedTLS) {
+    parts.push_back("emulated-tls");
+  }
+  // Without IRHASH_DEBUGINFO, the key doesn't cover the debug info
+  if (codegen.getDebugInfo() != llvm::codegenoptions::NoDebugInfo) {
+    parts.push_back("debug-info=" + std::to_string(codegen.getDebugInfo()));
+    parts.push_back("dwarf=" + std::to_string(codegen.DwarfVersion));
+    if (!codegen.SplitDwarfFile.empty()) {
+      parts.push_back(codegen.SplitDwarfInlining ? "split-dwarf" : "split-dwarf-no-inlining");
+    }
+  }
+  const std::pair<const char *, SanitizerSet> sanitizers[] = {
+      {"sanitize", CI.getLangOpts().Sanitize},
+      {"sanitize-recover", codegen.SanitizeRecover},
+      {"sanitize-trap", codegen.SanitizeTrap},
+  };
+  for (const auto &[name, set] : sanitizers) {
+    SmallVector<StringRef, 4> names;
+    serializeSanitizerSet(set, names);
+    if (!names.empty()) {
+      parts.push_back(name + ("=" + join(names, "+")));
+    }
   }
+  for (const std::string &arg : CI.getFrontendOpts().LLVMArgs) {
+    parts.push_back("-mllvm=" + arg);
+  }
+}
+#endif
 
-  // Write Hash to hashfile
-  if (atexit_mode == ATEXIT_FROM_CACHE) {
-    // Update Timestamp
-    utime(dst, NULL);
+/// The configuration of the compiler process, see withConfiguration(). It
+/// is the same for every module, so it is put together once.
+const std::string &IRHashPass::getConfiguration() {
+  static const std::string configuration = [] {
+    std::vector<std::string> parts{"llvm=" LLVM_VERSION_STRING};
+#ifdef WITH_CLANG_PLUGIN
+    if (CLANG_CI) {
+      clang_configuration(*CLANG_CI, parts);
+      return join(parts, ",");
+    }
+#endif
+    ArrayRef<std::string> args(command_line());
+    if (!args.empty() && (sys::path::stem(args[0]).contains("rustc") || option(args, "--crate-name"))) {
+      rustc_configuration(args, parts);
+    } else {
+      clang_configuration(args, parts);
+    }
+    // The same options select another CPU on another machine
+    if (any_of(parts, [](StringRef part) { return part.ends_with("=native"); })) {
+      parts.push_back("host-cpu=" + sys::getHostCPUName().str());
+    }
+    return join(parts, ",");
+  }();
+  return configuration;
+}
+
+/// The configuration of the compilation which runs this pass: that of the
+/// process and the optimization level of the pipeline.
+std::string IRHashPass::configuration() const {
+  return level.empty() ? getConfiguration() : getConfiguration() + ",opt=" + level.str();
+}
+
+/// Name of the optimization level \p Level, as the -O option selecting it.
+static StringRef level_name(OptimizationLevel Level) {
+  if (Level.getSizeLevel() > 0) {
+    return Level.getSizeLevel() == 1 ? "Os" : "Oz";
   }
+  const char *const names[] = {"O0", "O1", "O2", "O3"};
+  return names[Level.getSpeedupLevel()];
 }
 
 // This is the core interface for pass plugins. It guarantees that 'opt' will
@@ -524,11 +2177,26 @@ extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
   // https://github.com/Jakob-Koschel/llvm-passes#new-pass-manager
 
 #if PIPELINE == 0
+            // With IRHASH_TWO_STAGE, misses are looked up again after the optimizer
+            static const bool two_stage = getenv("IRHASH_TWO_STAGE");
             PB.registerPipelineStartEPCallback( // adding optimization once at the start of the pipeline
-                [&](ModulePassManager &MPM, OptimizationLevel Level) { MPM.addPass(IRHashPass("0")); });
+                [&](ModulePassManager &MPM, OptimizationLevel Level) {
+                  MPM.addPass(IRHashPass("0", two_stage ? IRHashPass::Stage::First : IRHashPass::Stage::Single,
+                                         level_name(Level)));
+                });
+            if (two_stage) {
+              PB.registerOptimizerLastEPCallback([&](ModulePassManager &MPM, OptimizationLevel Level) {
+                MPM.addPass(IRHashPass("1", IRHashPass::Stage::Second, level_name(Level)));
+              });
+            }
+            // The ThinLTO backend pipeline has no pipeline start
+            PB.registerPipelineEarlySimplificationEPCallback([&](ModulePassManager &MPM, OptimizationLevel Level) {
+              MPM.addPass(IRHashPass("0", IRHashPass::Stage::PostLink, level_name(Level)));
+            });
 #elif PIPELINE == 1
-            PB.registerOptimizerLastEPCallback(
-                [&](ModulePassManager &MPM, OptimizationLevel Level) { MPM.addPass(IRHashPass("1")); });
+            PB.registerOptimizerLastEPCallback([&](ModulePassManager &MPM, OptimizationLevel Level) {
+              MPM.addPass(IRHashPass("1", IRHashPass::Stage::Single, level_name(Level)));
+            });
 #else
 #error "PIPELINE not defined"
 #endif
@@ -1,11 +1,18 @@
 #ifndef IRHASH_PASS_H
 #define IRHASH_PASS_H
 
-#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/Module.h>
 #include <llvm/IR/PassManager.h>
 
+#include <chrono>
+#include <tuple>
+
 #include "hash.hpp"
 
+struct PendingOutput;
+
 namespace llvm {
 
 struct Symbol {
@@ -13,46 +20,160 @@ struct Symbol {
   StringRef name;
 };
 
-inline bool operator<(const Symbol &lhs, const Symbol &rhs) { return lhs.name < rhs.name || lhs.kind < rhs.kind; }
+inline bool operator<(const Symbol &lhs, const Symbol &rhs) {
+  return std::tie(lhs.name, lhs.kind) < std::tie(rhs.name, rhs.kind);
+}
+
+/// What the key of a module covers besides its code, configured by IRHASH_*
+/// variables. Every option changes the key, so modules hashed with different
+/// options never share cache entries.
+struct HashOptions {
+  bool DebugInfo = false; // IRHASH_DEBUGINFO: metadata, e.g. debug locations and variables
+  bool Canonical = false; // IRHASH_CANONICAL: local values by position only, not by name
+  bool Unordered = false; // IRHASH_UNORDERED: functions, globals and struct types sorted by name, not in module order
+  bool Prune = false;     // IRHASH_PRUNE: only functions and globals the exported definitions reach, see collectLive()
+
+  static HashOptions fromEnv();
+};
 
 /// The main IRHash pass.
 class IRHashPass : public PassInfoMixin<IRHashPass> {
+public:
+  /// Which lookup of a compilation the pass does.
+  enum class Stage {
+    Single, // the only one
+    First,  // IRHASH_TWO_STAGE: before optimization, a miss is looked up again by the second stage
+    Second, // IRHASH_TWO_STAGE: after optimization, for the misses of the first stage
+    PostLink // early in the ThinLTO backend, for codegen units which rustc links within the crate
+  };
+
 private:
-  Module *M = nullptr;
-  ModuleSlotTracker *MST = nullptr;
-  SlotTracker *SlotTable = nullptr;
-  Hasher ModuleHash;
   const char *pass; // pass name
+  Stage stage;
+  StringRef level; // optimization level of the pipeline, e.g. "O2", empty if unknown
+
+  /// Numbering of a function's local values.
+  /// Blocks and instructions get dense slots in the order the hashing
+  /// traversal first sees them, as a definition or as an operand, so no
+  /// separate pass numbers them. Every definition and use of a numbered
+  /// value hashes its slot, so e.g. swapping two forward references of a PHI
+  /// still changes the key. Arguments use their argument number.
+  struct LocalSlots {
+    DenseMap<const Value *, unsigned> Map;
+
+    unsigned get(const Value *V) { return Map.try_emplace(V, Map.size()).first->second; }
+    void reset() { Map.clear(); }
+  };
+
+  /// Numbering of a module's metadata nodes, if metadata is hashed.
+  /// Like the numbering of the IR printer, nodes get slots in the order a walk
+  /// of the module first reaches them. Each node is hashed once, and
+  /// references to it (including cyclic ones) are hashed as its slot.
+  struct MetadataSlots {
+    DenseMap<const MDNode *, unsigned> Map;
+    std::vector<const MDNode *> Nodes;   // by slot
+    SmallVector<StringRef, 0> KindNames; // of the attachments, by kind ID
+
+    void add(const Metadata *MD);
+    unsigned get(const MDNode *N) const { return Map.find(N)->second; }
+  };
+
+  /// Per-worker hashing state.
+  /// Every hashing thread owns one, so neither the slot numbering nor the
+  /// memoized digests are shared. The metadata numbering is complete before
+  /// the workers start, they only read it.
+  struct HashContext {
+    LocalSlots Slots;
+    DenseMap<const Type *, Hasher::Digest> TypeDigests;
+    DenseMap<const Constant *, Hasher::Digest> ConstantDigests;
+    const MetadataSlots *MD = nullptr; // null unless metadata is hashed
+    bool Canonical = false;            // names of blocks, arguments and instructions are ignored
+    bool Prune = false;                // the named struct types hashed by name are collected in Structs
+    SmallPtrSet<const StructType *, 8> Structs;
+  };
 
   static bool isStatic(const GlobalValue *GV);
-  static void hashType(const Type *T, Hasher &hash);
-  static void hashValue(const Constant *CV, Hasher &hash);
-  static void hashGlobalVariable(const GlobalVariable &GV, Hasher &hash);
-  void hashFunction(const Function &F, Hasher &hash);
+  static void hashType(const Type *T, HashContext &Ctx, Hasher &hash);
+  static void hashTypeUncached(const Type *T, HashContext &Ctx, Hasher &hash);
+  static void hashValue(const Constant *CV, HashContext &Ctx, Hasher &hash);
+  static void hashAggregate(const Constant *CV, HashContext &Ctx, Hasher &hash);
+  static void hashAttributes(AttributeSet Attrs, HashContext &Ctx, Hasher &hash);
+  static void hashAttributes(const AttributeList &Attrs, HashContext &Ctx, Hasher &hash);
+  static void hashGlobalVariable(const GlobalVariable &GV, HashContext &Ctx, Hasher &hash);
+  static void hashFunction(const Function &F, HashContext &Ctx, Hasher &hash);
+  static void collectMetadata(const Module &M, ArrayRef<const GlobalObject *> Entities, MetadataSlots &MD);
+  static void hashMetadataNodes(const Module &M, HashContext &Ctx, Hasher &hash);
+  static void hashMetadata(const Metadata *MD, HashContext &Ctx, Hasher &hash);
+  static void hashAttachments(ArrayRef<std::pair<unsigned, MDNode *>> MDs, HashContext &Ctx, Hasher &hash);
+  static void hashDebugRecords(const Instruction &I, HashContext &Ctx, Hasher &hash);
+
+  /// How a hit replaces the object file of a module.
+  enum class HitMode {
+    Exit,     // the compiler exits, the object file is restored at exit
+    AtExit,   // the compiler goes on with other modules, restored at exit
+    OnDestroy // restored once the compiler has written the module and destroys it
+  };
+  struct ModuleOutput {
+    std::string objectfile; // empty if the module can't be cached
+    HitMode mode = HitMode::Exit;
+    std::string kind;     // of objectfile if it isn't a plain object file, e.g. "thin-lto", see withKind()
+    bool bitcode = false; // objectfile is LLVM bitcode
+    std::vector<std::pair<std::string, std::string>> extras; // role and path of further files the compiler writes
+    bool post_link = false; // objectfile is compiled by the ThinLTO backend, see Stage::PostLink
+  };
 
-  static std::string getOutFile();
-  static void link_object_file();
+  static unsigned getThreadCount();
+  static ModuleOutput getClangOutput();
+  static ModuleOutput getOutput(const Module &M);
+  std::string configuration() const;
+  static void openStats(const char *cachedir);
+  static bool lookup(const char *cachedir, PendingOutput &output);
+  static PreservedAnalyses runSecondStage(Module &M, StringRef configuration);
+  static PreservedAnalyses finishModule(Module &M, HitMode mode, PendingOutput &pending);
 
 public:
+  /// Version of the key layout.
+  /// Bump it whenever the same IR would get a different key.
+  static constexpr uint64_t KeyVersion = 6;
+
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
-  IRHashPass(const char *pass) : pass(pass) {}
-  IRHashPass(IRHashPass &&other) : ModuleHash(std::move(other.ModuleHash)) {
-    MST = other.MST;
-    other.MST = nullptr;
-
-    M = other.M;
-    other.M = nullptr;
-
-    SlotTable = other.SlotTable;
-    other.SlotTable = nullptr;
-
-    pass = other.pass;
-  }
-  ~IRHashPass() {
-    if (MST) {
-      free(MST);
-    }
-  }
+  IRHashPass(const char *pass, Stage stage = Stage::Single, StringRef level = "")
+      : pass(pass), stage(stage), level(level) {}
+
+  /// Compute the cache key of \p M.
+  /// Functions and globals are hashed into separate digests on \p Threads
+  /// workers and combined in module order (by name with Options.Unordered),
+  /// so the key does not depend on the number of threads. \p Options select
+  /// what else the key covers.
+  static Hasher::Digest hashModule(const Module &M, unsigned Threads = 1, const HashOptions &Options = {});
+
+  /// Collect the functions, globals, aliases and ifuncs the object file of
+  /// \p M depends on: the definitions it exports and every symbol their code
+  /// or initializers reach. Options.Prune hashes only these, so unused
+  /// declarations and dead internal symbols don't change the key.
+  /// References from metadata don't count.
+  static void collectLive(const Module &M, SmallPtrSetImpl<const GlobalValue *> &Live);
+
+  /// Key of the output of \p kind compiled from a module with the key \p IR.
+  /// The same module compiled for LTO, or with different options for its
+  /// summary, gets a different key. Plain object files (empty \p kind) keep
+  /// the key of the module.
+  static Hasher::Digest withKind(const Hasher::Digest &IR, StringRef kind);
+
+  /// Key of the output with the key \p key compiled in \p configuration,
+  /// everything besides the IR which changes the generated code, e.g. the
+  /// target CPU or the optimization level. A cache shared by builds with
+  /// different configurations keeps their entries apart.
+  static Hasher::Digest withConfiguration(const Hasher::Digest &key, StringRef configuration);
+
+  /// Configuration of the current compiler process without the optimization
+  /// level, which the pipeline adds.
+  static const std::string &getConfiguration();
+
+  /// Look up \p key, which the direct mode of the Clang plugin found in a
+  /// manifest starting at \p check_start, before there is any IR. On a hit,
+  /// the object file is restored when the compiler exits.
+  static bool lookupDirect(const std::string &key, std::chrono::steady_clock::time_point check_start);
 
   static bool isRequired() { return true; }
   void setPass(const char *pass) { this->pass = pass; }
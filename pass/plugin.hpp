@@ -1,20 +1,226 @@
 #ifndef IRHASH_PLUGIN_HPP
 #define IRHASH_PLUGIN_HPP
 
+#include "manifest.hpp"
+#include "pass.hpp"
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Basic/Version.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendAction.h>
 #include <clang/Frontend/FrontendPluginRegistry.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
 
 using namespace clang;
 
 static const CompilerInstance *CLANG_CI = nullptr;
 
+/// Direct mode (IRHASH_DIRECT): a compilation whose manifest is up to date
+/// restores its object file before the source is even parsed. Otherwise the
+/// files the preprocessor reads are collected and the manifest is written
+/// once the IR has a key, see manifest.hpp.
+struct DirectMode {
+  std::string path; // of this compilation's manifest, empty if the direct mode isn't used
+  Manifest manifest;
+  bool uncacheable = false; // the IR differs every time, e.g. because of __DATE__
+};
+static DirectMode direct_mode;
+
+/// Collects the headers of the compilation for its manifest.
+class DirectModeCallbacks : public PPCallbacks {
+  SourceManager &SM;
+  StringSet<> seen;
+
+public:
+  DirectModeCallbacks(SourceManager &SM) : SM(SM) {}
+
+  void FileChanged(SourceLocation Loc, FileChangeReason Reason, SrcMgr::CharacteristicKind FileType,
+                   FileID PrevFID) override {
+    if (Reason != EnterFile) {
+      return;
+    }
+    // The main file is part of the manifest's name, <built-in> and the like aren't files
+    FileID FID = SM.getFileID(Loc);
+    OptionalFileEntryRef File = SM.getFileEntryRefForID(FID);
+    if (FID == SM.getMainFileID() || !File || !seen.insert(File->getName()).second) {
+      return;
+    }
+    // Hash what was compiled, the file may have changed on disk since
+    std::optional<StringRef> data = SM.getBufferDataOrNone(FID);
+    if (!data) {
+      direct_mode.uncacheable = true;
+      return;
+    }
+    direct_mode.manifest.add(*data, SrcMgr::isSystem(FileType) ? Manifest::SystemHeader : Manifest::UserHeader,
+                             File->getName());
+  }
+
+  void MacroExpands(const Token &MacroNameTok, const MacroDefinition &MD, SourceRange Range,
+                    const MacroArgs *Args) override {
+    StringRef name = MacroNameTok.getIdentifierInfo()->getName();
+    if (name == "__DATE__" || name == "__TIME__" || name == "__TIMESTAMP__") {
+      direct_mode.uncacheable = true;
+    }
+  }
+};
+
+/// Escape \p path for a Makefile rule.
+static std::string make_escape(StringRef path) {
+  std::string escaped;
+  for (char c : path) {
+    if (c == ' ' || c == '#') {
+      escaped += '\\';
+    } else if (c == '$') {
+      escaped += '$';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+/// Write the dependency file (-MD, -MMD) of a direct hit, which the
+/// preprocessor would have written.
+static void write_dependency_file(const CompilerInstance &CI, StringRef source, const Manifest &manifest) {
+  const DependencyOutputOptions &opts = CI.getDependencyOutputOpts();
+  if (opts.OutputFile.empty()) {
+    return;
+  }
+
+  std::vector<StringRef> deps{source};
+  for (const Manifest::Input &input : manifest.inputs) {
+    if (input.kind == Manifest::UserHeader || input.kind == Manifest::Extra ||
+        (input.kind == Manifest::SystemHeader && opts.IncludeSystemHeaders)) {
+      deps.push_back(input.path);
+    }
+  }
+
+  std::error_code ec;
+  raw_fd_ostream out(opts.OutputFile, ec, sys::fs::OF_Text);
+  if (ec) {
+    return;
+  }
+  if (opts.Targets.empty()) {
+    out << make_escape(CI.getFrontendOpts().OutputFile);
+  }
+  for (size_t i = 0; i < opts.Targets.size(); i++) {
+    out << (i ? " " : "") << opts.Targets[i];
+  }
+  out << ':';
+  for (StringRef dep : deps) {
+    out << " \\\n  " << make_escape(dep);
+  }
+  out << '\n';
+  if (opts.UsePhonyTargets) {
+    for (StringRef dep : ArrayRef(deps).drop_front()) {
+      out << '\n' << make_escape(dep) << ":\n";
+    }
+  }
+}
+
+/// Start the direct mode before the source is parsed: restore the object
+/// file and exit if the manifest of the compilation is up to date, otherwise
+/// collect the inputs for a new manifest.
+static void direct_mode_start(CompilerInstance &CI) {
+  const auto check_start = std::chrono::steady_clock::now();
+  const char *cachedir = getenv("IRHASH_CACHE");
+  const FrontendOptions &opts = CI.getFrontendOpts();
+
+  // Only compilations of a single source file to an object file. The
+  // contents of modules and precompiled headers aren't tracked, and included
+  // files are looked up relative to the current directory.
+  if (!cachedir || opts.ProgramAction != frontend::EmitObj || opts.Inputs.size() != 1 || !opts.Inputs[0].isFile() ||
+      opts.OutputFile.empty() || opts.OutputFile == "-" || CI.getLangOpts().Modules ||
+      !CI.getPreprocessorOpts().ImplicitPCHInclude.empty() || !CI.getFileSystemOpts().WorkingDir.empty()) {
+    return;
+  }
+
+  const std::string source(opts.Inputs[0].getFile());
+  const std::string source_digest(Manifest::digest_of_file(source));
+  SmallString<256> cwd;
+  if (source_digest.empty() || sys::fs::current_path(cwd)) {
+    return;
+  }
+
+  // The manifest is named after everything that determines the compilation
+  // besides the contents of the other files: the compiler, its arguments
+  // (except for the output file), the directory, and the source. The options
+  // of the key are part of it too, the same IR has another key in each mode.
+  Hasher hash;
+  auto add = [&](StringRef str) {
+    hash.update((uint64_t)str.size());
+    hash.update(str);
+  };
+  add(Hasher::Algorithm);
+  const HashOptions options = HashOptions::fromEnv();
+  hash.update(IRHashPass::KeyVersion);
+  hash.update((uint64_t)options.DebugInfo);
+  hash.update((uint64_t)options.Canonical);
+  hash.update((uint64_t)options.Unordered);
+  hash.update((uint64_t)options.Prune);
+  add(getClangFullVersion());
+  const std::vector<std::string> args = CI.getInvocation().getCC1CommandLine();
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i] == "-o") {
+      i++;
+      continue;
+    }
+    add(args[i]);
+  }
+  add(cwd);
+  add(source_digest);
+  Hasher::Digest digest;
+  hash.final(digest);
+  direct_mode.path = Manifest::path(cachedir, digest.digest());
+
+  // Inputs the preprocessor doesn't read
+  for (const auto &[dep, kind] : CI.getDependencyOutputOpts().ExtraDeps) {
+    if (!direct_mode.manifest.add_file(dep, Manifest::Extra)) {
+      direct_mode.path.clear();
+      return;
+    }
+  }
+  const CodeGenOptions &codegen = CI.getCodeGenOpts();
+  for (const std::string &profile :
+       {codegen.ProfileInstrumentUsePath, codegen.SampleProfileFile, codegen.ProfileRemappingFile}) {
+    if (!profile.empty() && !direct_mode.manifest.add_file(profile, Manifest::Hidden)) {
+      direct_mode.path.clear();
+      return;
+    }
+  }
+
+  Manifest found;
+  if (found.read(direct_mode.path) && found.up_to_date() && IRHashPass::lookupDirect(found.key, check_start)) {
+    write_dependency_file(CI, source, found);
+    exit(0);
+  }
+
+  CI.getPreprocessor().addPPCallbacks(std::make_unique<DirectModeCallbacks>(CI.getSourceManager()));
+}
+
+/// Write the manifest of the compilation, whose IR has the key \p key.
+static void direct_mode_record(StringRef key) {
+  if (direct_mode.path.empty() || direct_mode.uncacheable) {
+    return;
+  }
+  direct_mode.manifest.key = key.str();
+  direct_mode.manifest.write(direct_mode.path);
+  // Once per compilation, like the lookup
+  direct_mode.path.clear();
+}
+
 // The clang plugin.
-// It's only used to get to the CompilerInstance which is static.
+// It gets the CompilerInstance which is static, and runs the direct mode.
 class PassCIAction : public PluginASTAction {
 
 protected:
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI, llvm::StringRef) override {
+    if (getenv("IRHASH_DIRECT")) {
+      direct_mode_start(CI);
+    }
     return std::make_unique<ASTConsumer>();
   }
 
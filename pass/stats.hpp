@@ -0,0 +1,118 @@
+#ifndef IRHASH_STATS_HPP
+#define IRHASH_STATS_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Counters about the effectiveness of the cache, in the memory-mapped file
+/// `<cache>/STATS`. Compilations update them with atomic adds, so they don't
+/// need any locking.
+struct CacheStats {
+  enum Counter {
+    Hits,
+    Misses,
+    Stores,
+    StoreFailures,
+    RestoreFailures,
+    BytesRestored,
+    BytesStored,
+    HashNanos,     // hashing, all compilations
+    HitNanos,      // from the lookup until the object file is restored
+    MissNanos,     // from the lookup until the compiler exits, i.e. what a hit saves
+    StoreNanos,    // storing the object file
+    DirectHits,    // hits found by a manifest of the direct mode, also counted as hits
+    OptimizedHits, // hits of the optimized module (IRHASH_TWO_STAGE), also counted as hits
+    NumCounters
+  };
+
+  static constexpr const char *Names[NumCounters] = {
+      "hits",           "misses",  "stores", "store_failures", "restore_failures", "bytes_restored",
+      "bytes_stored",   "hash_ns", "hit_ns", "miss_ns",        "store_ns",         "direct_hits",
+      "optimized_hits",
+  };
+
+  static constexpr uint64_t Magic = 0x3130415453485249; // "IRHSTA01"
+  static constexpr unsigned Capacity = 56;             // room for more counters in the same file
+
+  struct File {
+    uint64_t magic;
+    uint64_t reserved[7];
+    std::atomic<uint64_t> counters[Capacity];
+  };
+  static_assert(NumCounters <= Capacity, "STATS layout");
+
+  File *file = nullptr;
+
+  CacheStats() = default;
+  CacheStats(const CacheStats &) = delete;
+  CacheStats &operator=(const CacheStats &) = delete;
+  ~CacheStats() {
+    if (file) {
+      munmap(file, sizeof(File));
+    }
+  }
+
+  /// Map `STATS` in \p cachedir, creating it if it doesn't exist yet.
+  bool open(const std::string &cachedir) {
+    if (file) {
+      return true;
+    }
+    const std::string path(cachedir + "/STATS");
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+      // Zeroed counters appear under the name at once, concurrent creators agree on one of them
+      const std::string tmp(path + ".tmp." + std::to_string(getpid()));
+      int tmpfd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      const uint64_t magic = Magic;
+      if (tmpfd >= 0 && ftruncate(tmpfd, sizeof(File)) == 0 && pwrite(tmpfd, &magic, sizeof(magic), 0) == sizeof(magic)) {
+        link(tmp.c_str(), path.c_str());
+      }
+      if (tmpfd >= 0) {
+        ::close(tmpfd);
+      }
+      unlink(tmp.c_str());
+      fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == sizeof(File)) {
+      map = mmap(nullptr, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+    file = (File *)map;
+    if (file->magic != Magic) {
+      munmap(file, sizeof(File));
+      file = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  void add(Counter counter, uint64_t value = 1) {
+    if (file) {
+      file->counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t get(Counter counter) const { return file ? file->counters[counter].load(std::memory_order_relaxed) : 0; }
+
+  void zero() {
+    for (unsigned i = 0; file && i < Capacity; i++) {
+      file->counters[i].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+#endif // IRHASH_STATS_HPP
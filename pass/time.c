@@ -0,0 +1,12 @@
+// Preloaded (LD_PRELOAD) into the compiler during the evaluation.
+// Records when the process started, before the compiler's own
+// initialization, so the validation pass (pass0.so) can tell how long the
+// frontend took until the module got hashed.
+
+#include <time.h>
+
+struct timespec irhash_start_time;
+
+__attribute__((constructor)) static void irhash_record_start_time(void) {
+  clock_gettime(CLOCK_MONOTONIC, &irhash_start_time);
+}